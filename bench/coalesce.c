@@ -0,0 +1,78 @@
+/*
+ * Compares immediate and deferred coalescing (SF_OPT_DEFER_COALESCE) on two workloads:
+ * ping-pong, where each freed block is requested again right away, and a random mix of
+ * small sizes over a set of live blocks. Every run gets a fresh heap in a child process.
+ *
+ * usage: bin/coalesce [operations]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "sfmm.h"
+
+#define LIVE_BLOCKS 4096
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void ping_pong(void **blocks, long ops)
+{
+    for (long i = 0; i < ops; i++)
+    {
+        size_t slot = i % LIVE_BLOCKS;
+        size_t size = 32 + (slot % 8) * 64;
+        sf_free(blocks[slot]);
+        blocks[slot] = sf_malloc(size);
+    }
+}
+
+static void random_mix(void **blocks, long ops)
+{
+    for (long i = 0; i < ops; i++)
+    {
+        size_t slot = rand() % LIVE_BLOCKS;
+        sf_free(blocks[slot]);
+        blocks[slot] = sf_malloc(16 + rand() % 1000);
+    }
+}
+
+static void run(const char *name, void (*workload)(void **, long), int defer, long ops)
+{
+    if (fork() != 0)
+    {
+        wait(NULL);
+        return;
+    }
+
+    static void *blocks[LIVE_BLOCKS];
+    sf_mallopt(SF_OPT_HEAP_MAX, 256 << 20);
+    sf_mallopt(SF_OPT_DEFER_COALESCE, defer);
+    srand(1);
+    for (int i = 0; i < LIVE_BLOCKS; i++)
+        blocks[i] = sf_malloc(32 + (i % 8) * 64);
+
+    double start = now();
+    workload(blocks, ops);
+    double elapsed = now() - start;
+
+    printf("%-10s %-9s %10.0f ops/s\n", name, defer ? "deferred" : "immediate", ops / elapsed);
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char const *argv[])
+{
+    long ops = (argc > 1) ? atol(argv[1]) : 2000000;
+
+    run("ping-pong", ping_pong, 0, ops);
+    run("ping-pong", ping_pong, 1, ops);
+    run("random", random_mix, 0, ops);
+    run("random", random_mix, 1, ops);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,112 @@
+/*
+ * Compares the heap backends on a large heap: fills it with blocks of random sizes, then
+ * frees and reallocates random blocks so that find_block() and coalesce() touch headers
+ * and footers all over the heap. Prints the throughput and, where perf events are
+ * available, the number of dTLB load misses per operation.
+ *
+ * usage: bin/hugepages [mmap|thp|hugetlb] [heap MB] [operations]
+ */
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "sfmm.h"
+
+#define MIN_BLOCK 64
+#define MAX_BLOCK 4096
+
+static int dtlb_counter()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t random_size()
+{
+    return MIN_BLOCK + rand() % (MAX_BLOCK - MIN_BLOCK);
+}
+
+int main(int argc, char const *argv[])
+{
+    const char *name = (argc > 1) ? argv[1] : "mmap";
+    long heap_mb = (argc > 2) ? atol(argv[2]) : 1024;
+    long ops = (argc > 3) ? atol(argv[3]) : 2000000;
+
+    long backend = SF_BACKEND_MMAP;
+    if (strcmp(name, "thp") == 0)
+        backend = SF_BACKEND_THP;
+    else if (strcmp(name, "hugetlb") == 0)
+        backend = SF_BACKEND_HUGETLB;
+    else if (strcmp(name, "mmap") != 0)
+    {
+        fprintf(stderr, "usage: %s [mmap|thp|hugetlb] [heap MB] [operations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    sf_mallopt(SF_OPT_BACKEND, backend);
+    sf_mallopt(SF_OPT_HEAP_MAX, heap_mb << 20);
+
+    // Fill three quarters of the heap so that later requests have to search for space
+    size_t count = (heap_mb << 20) / 4 * 3 / ((MIN_BLOCK + MAX_BLOCK) / 2 + 64);
+    void **blocks = calloc(count, sizeof(void *));
+    srand(1);
+    for (size_t i = 0; i < count; i++)
+    {
+        blocks[i] = sf_malloc(random_size());
+        if (blocks[i] == NULL)
+        {
+            fprintf(stderr, "heap full after %zu blocks\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int counter = dtlb_counter();
+    if (counter != -1)
+    {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    double start = now();
+    for (long i = 0; i < ops; i++)
+    {
+        size_t victim = rand() % count;
+        sf_free(blocks[victim]);
+        blocks[victim] = sf_malloc(random_size());
+    }
+    double elapsed = now() - start;
+
+    long long misses = -1;
+    if (counter != -1)
+    {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &misses, sizeof(misses)) != sizeof(misses))
+            misses = -1;
+        close(counter);
+    }
+
+    printf("%-8s heap %5ld MB  %10.0f ops/s", name, heap_mb, ops / elapsed);
+    if (misses >= 0)
+        printf("  %8.3f dTLB misses/op", (double)misses / ops);
+    else
+        printf("  dTLB misses n/a");
+    printf("\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,342 @@
+/*
+ * Replays allocation traces (malloclab format, see traces/gen_traces.py) against the
+ * allocator and reports, per trace, the throughput, the memory utilization: the peak
+ * total of live payload bytes over the peak heap size, sf_mem_end() - sf_mem_start(),
+ * and the external fragmentation of sf_get_stats() averaged over the trace.
+ * Every trace runs in a child process of its own, so each one starts from a fresh heap.
+ *
+ * usage: bin/mdriver [-c] [-r repeats] [-o param=value]... [trace]...
+ *   -c            fill every payload and check it is intact when it is freed or resized
+ *   -r repeats    number of timed replays of each trace (default 10)
+ *   -o p=v        call sf_mallopt(p, v) before replaying, e.g. -o 8=1
+ * Without trace arguments, every .rep file in traces/ is replayed.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "sfmm.h"
+
+#define TRACE_DIR "traces"
+#define MAX_TRACES 64
+#define MAX_OPTIONS 16
+#define HEAP_MAX (1L << 30)
+#define FRAG_INTERVAL 100
+
+typedef struct trace_op {
+    char type;
+    int id;
+    size_t size;
+} trace_op;
+
+typedef struct trace {
+    int num_ids;
+    int num_ops;
+    trace_op *ops;
+} trace;
+
+typedef struct result {
+    int valid;
+    double secs;
+    size_t heap_peak;
+    size_t live_peak;
+    double frag_total;
+    int frag_samples;
+} result;
+
+static int check_payloads;
+static int repeats = 10;
+static long options[MAX_OPTIONS][2];
+static int num_options;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Reads a trace file.
+ *
+ * @param path
+ * @param t trace to fill in
+ * @return int 0 if successful, -1 if the file cannot be read or is malformed
+ */
+static int read_trace(const char *path, trace *t)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+
+    int heap_size, weight;
+    if (fscanf(file, "%d %d %d %d", &heap_size, &t->num_ids, &t->num_ops, &weight) != 4 ||
+        t->num_ids <= 0 || t->num_ops <= 0)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    t->ops = calloc(t->num_ops, sizeof(trace_op));
+    for (int i = 0; i < t->num_ops; i++)
+    {
+        trace_op *op = &t->ops[i];
+        char type[2];
+        if (fscanf(file, "%1s %d", type, &op->id) != 2 || op->id < 0 || op->id >= t->num_ids)
+            break;
+        op->type = type[0];
+        if ((op->type == 'a' || op->type == 'r') && fscanf(file, "%zu", &op->size) != 1)
+            break;
+        if (op->type != 'a' && op->type != 'r' && op->type != 'f')
+            break;
+        if (i == t->num_ops - 1)
+        {
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+    free(t->ops);
+    return -1;
+}
+
+static int payload_intact(unsigned char *pp, size_t size, int id)
+{
+    for (size_t i = 0; i < size; i++)
+        if (pp[i] != (unsigned char)id)
+            return 0;
+    return 1;
+}
+
+/**
+ * @brief Replays a trace once.
+ *
+ * @param t
+ * @param blocks one slot per id
+ * @param sizes one slot per id
+ * @param r if not NULL, checks the results of each operation and records the peaks
+ * @return int 1 if every operation succeeded, 0 otherwise
+ */
+static int replay(trace *t, void **blocks, size_t *sizes, result *r)
+{
+    size_t live = 0;
+    for (int i = 0; i < t->num_ops; i++)
+    {
+        trace_op *op = &t->ops[i];
+        switch (op->type)
+        {
+        case 'a':
+            blocks[op->id] = sf_malloc(op->size);
+            if (blocks[op->id] == NULL)
+                return 0;
+            sizes[op->id] = op->size;
+            if (r != NULL && check_payloads)
+                memset(blocks[op->id], op->id, op->size);
+            live += op->size;
+            break;
+        case 'r':
+            if (r != NULL && check_payloads && !payload_intact(blocks[op->id], sizes[op->id], op->id))
+                return 0;
+            blocks[op->id] = sf_realloc(blocks[op->id], op->size);
+            if (blocks[op->id] == NULL)
+                return 0;
+            if (r != NULL && check_payloads)
+            {
+                size_t kept = (op->size < sizes[op->id]) ? op->size : sizes[op->id];
+                if (!payload_intact(blocks[op->id], kept, op->id))
+                    return 0;
+                memset(blocks[op->id], op->id, op->size);
+            }
+            live += op->size - sizes[op->id];
+            sizes[op->id] = op->size;
+            break;
+        case 'f':
+            if (r != NULL && check_payloads && !payload_intact(blocks[op->id], sizes[op->id], op->id))
+                return 0;
+            sf_free(blocks[op->id]);
+            live -= sizes[op->id];
+            break;
+        }
+        if (r != NULL)
+        {
+            size_t heap = sf_mem_end() - sf_mem_start();
+            if (heap > r->heap_peak)
+                r->heap_peak = heap;
+            if (live > r->live_peak)
+                r->live_peak = live;
+            if (i % FRAG_INTERVAL == 0)
+            {
+                struct sf_stats stats;
+                sf_get_stats(&stats);
+                r->frag_total += stats.fragmentation;
+                r->frag_samples++;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Runs a trace in a child process: one checked replay that records
+ * the peaks, then the timed replays.
+ *
+ * @param t
+ * @return result
+ */
+static result run_trace(trace *t)
+{
+    result r = {0};
+    int fds[2];
+    if (pipe(fds) == -1)
+        return r;
+
+    fflush(stdout);
+    if (fork() == 0)
+    {
+        close(fds[0]);
+        sf_mallopt(SF_OPT_HEAP_MAX, HEAP_MAX);
+        for (int i = 0; i < num_options; i++)
+            sf_mallopt(options[i][0], options[i][1]);
+
+        void **blocks = calloc(t->num_ids, sizeof(void *));
+        size_t *sizes = calloc(t->num_ids, sizeof(size_t));
+        r.valid = replay(t, blocks, sizes, &r);
+
+        double start = now();
+        for (int i = 0; r.valid && i < repeats; i++)
+            r.valid = replay(t, blocks, sizes, NULL);
+        r.secs = now() - start;
+
+        if (write(fds[1], &r, sizeof(r)) != sizeof(r))
+            exit(EXIT_FAILURE);
+        exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    if (read(fds[0], &r, sizeof(r)) != sizeof(r))
+        r.valid = 0;
+    close(fds[0]);
+    wait(NULL);
+    return r;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * @brief Lists the .rep files of TRACE_DIR in name order.
+ *
+ * @param paths array of MAX_TRACES paths to fill in
+ * @return int number of traces
+ */
+static int find_traces(char **paths)
+{
+    DIR *dir = opendir(TRACE_DIR);
+    if (dir == NULL)
+        return 0;
+
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL && count < MAX_TRACES)
+    {
+        size_t length = strlen(entry->d_name);
+        if (length > 4 && strcmp(entry->d_name + length - 4, ".rep") == 0)
+        {
+            paths[count] = malloc(strlen(TRACE_DIR) + length + 2);
+            sprintf(paths[count++], "%s/%s", TRACE_DIR, entry->d_name);
+        }
+    }
+    closedir(dir);
+    qsort(paths, count, sizeof(char *), compare_names);
+    return count;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "cr:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            check_payloads = 1;
+            break;
+        case 'r':
+            repeats = atoi(optarg);
+            if (repeats < 1)
+                goto usage;
+            break;
+        case 'o':
+            if (num_options == MAX_OPTIONS ||
+                sscanf(optarg, "%ld=%ld", &options[num_options][0], &options[num_options][1]) != 2)
+                goto usage;
+            num_options++;
+            break;
+        default:
+            goto usage;
+        }
+    }
+
+    char *paths[MAX_TRACES];
+    int count = argc - optind;
+    if (count > MAX_TRACES)
+        count = MAX_TRACES;
+    for (int i = 0; i < count; i++)
+        paths[i] = argv[optind + i];
+    if (count == 0)
+        count = find_traces(paths);
+    if (count == 0)
+    {
+        fprintf(stderr, "no traces found in %s/\n", TRACE_DIR);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-20s %5s %8s %10s %10s %10s %6s %6s\n", "trace", "valid", "ops", "secs", "Kops/s", "heap KB",
+           "util", "frag");
+    long total_ops = 0;
+    double total_secs = 0, total_util = 0, total_frag = 0;
+    int measured = 0;
+    for (int i = 0; i < count; i++)
+    {
+        trace t;
+        if (read_trace(paths[i], &t) == -1)
+        {
+            printf("%-20s cannot read trace\n", paths[i]);
+            continue;
+        }
+        const char *name = strrchr(paths[i], '/') ? strrchr(paths[i], '/') + 1 : paths[i];
+        result r = run_trace(&t);
+        if (!r.valid)
+        {
+            printf("%-20s %5s\n", name, "no");
+            free(t.ops);
+            continue;
+        }
+
+        long ops = (long)t.num_ops * repeats;
+        double util = (r.heap_peak == 0) ? 0 : (double)r.live_peak / r.heap_peak;
+        double frag = (r.frag_samples == 0) ? 0 : r.frag_total / r.frag_samples;
+        printf("%-20s %5s %8ld %10.4f %10.0f %10zu %5.1f%% %5.1f%%\n", name, "yes", ops, r.secs,
+               ops / r.secs / 1000, r.heap_peak / 1024, 100 * util, 100 * frag);
+        total_ops += ops;
+        total_secs += r.secs;
+        total_util += util;
+        total_frag += frag;
+        measured++;
+        free(t.ops);
+    }
+    if (measured > 0)
+        printf("%-20s %5s %8ld %10.4f %10.0f %10s %5.1f%% %5.1f%%\n", "total", "", total_ops, total_secs,
+               total_ops / total_secs / 1000, "", 100 * total_util / measured, 100 * total_frag / measured);
+    return (measured == count) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+usage:
+    fprintf(stderr, "usage: %s [-c] [-r repeats] [-o param=value]... [trace]...\n", argv[0]);
+    return EXIT_FAILURE;
+}
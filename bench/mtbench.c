@@ -0,0 +1,321 @@
+/*
+ * Multi-threaded scalability benchmarks, run with sf_malloc/sf_free and with the glibc
+ * malloc/free side by side at 1, 2, 4, ... up to the given number of threads:
+ *
+ *   larson         threads replace random blocks of random sizes in their own set, and
+ *                  pass the sets on to the next thread between rounds, so blocks are
+ *                  freed by threads other than the one that allocated them
+ *   threadtest     each thread allocates a batch of small blocks, then frees them all
+ *   xmalloc        producer threads allocate blocks that consumer threads free
+ *                  (one consumer per producer)
+ *   cache-scratch  each thread frees a block allocated next to the others' by the main
+ *                  thread, then allocates, writes and frees small blocks of its own;
+ *                  slow when the allocator hands out blocks sharing a cache line
+ *
+ * Every configuration runs in a child process of its own. Reports operations (each
+ * allocation and each free is one) per second and the peak RSS of the child.
+ *
+ * usage: bin/mtbench [-t max threads] [-b benchmark] [-o param=value]...
+ *   -o p=v        call sf_mallopt(p, v) before running, e.g. -o 9=1
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "sfmm.h"
+
+#define MAX_THREADS 64
+#define MAX_OPTIONS 16
+
+typedef struct allocator {
+    const char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+} allocator;
+
+static const allocator allocators[] = {
+    { "sfmm", sf_malloc, sf_free },
+    { "glibc", malloc, free },
+};
+
+static const allocator *use;
+static int num_threads;
+static pthread_barrier_t barrier;
+static long options[MAX_OPTIONS][2];
+static int num_options;
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Runs fn in num_threads threads, passing each its index. */
+static void run_threads(void *(*fn)(void *), int count)
+{
+    pthread_t threads[2 * MAX_THREADS];
+    for (long i = 0; i < count; i++)
+        pthread_create(&threads[i], NULL, fn, (void *)i);
+    for (int i = 0; i < count; i++)
+        pthread_join(threads[i], NULL);
+}
+
+/* larson */
+
+#define LARSON_SLOTS 1000
+#define LARSON_ROUNDS 10
+#define LARSON_OPS 20000
+
+static void *larson_sets[MAX_THREADS][LARSON_SLOTS];
+
+static void *larson_thread(void *arg)
+{
+    long self = (long)arg;
+    unsigned int seed = self + 1;
+    for (int round = 0; round < LARSON_ROUNDS; round++)
+    {
+        // Take over the set another thread used in the previous round
+        void **set = larson_sets[(self + round) % num_threads];
+        for (int i = 0; i < LARSON_OPS; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            int slot = (seed >> 8) % LARSON_SLOTS;
+            use->free(set[slot]);
+            set[slot] = use->malloc(16 + (seed >> 16) % 1000);
+        }
+        pthread_barrier_wait(&barrier);
+    }
+    return NULL;
+}
+
+static long larson()
+{
+    for (int t = 0; t < num_threads; t++)
+        for (int i = 0; i < LARSON_SLOTS; i++)
+            larson_sets[t][i] = use->malloc(16 + (i * 37) % 1000);
+    pthread_barrier_init(&barrier, NULL, num_threads);
+    run_threads(larson_thread, num_threads);
+    pthread_barrier_destroy(&barrier);
+    return 2L * LARSON_ROUNDS * LARSON_OPS * num_threads;
+}
+
+/* threadtest */
+
+#define THREADTEST_BATCH 2000
+#define THREADTEST_ITERATIONS 50
+
+static void *threadtest_thread(void *arg)
+{
+    void **blocks = malloc(THREADTEST_BATCH * sizeof(void *));
+    for (int n = 0; n < THREADTEST_ITERATIONS; n++)
+    {
+        for (int i = 0; i < THREADTEST_BATCH; i++)
+            blocks[i] = use->malloc(64);
+        for (int i = 0; i < THREADTEST_BATCH; i++)
+            use->free(blocks[i]);
+    }
+    free(blocks);
+    return NULL;
+}
+
+static long threadtest()
+{
+    run_threads(threadtest_thread, num_threads);
+    return 2L * THREADTEST_BATCH * THREADTEST_ITERATIONS * num_threads;
+}
+
+/* xmalloc */
+
+#define XMALLOC_RING 1024
+#define XMALLOC_OBJECTS 200000
+
+typedef struct ring {
+    void *slots[XMALLOC_RING];
+    unsigned long head __attribute__((aligned(64)));
+    unsigned long tail __attribute__((aligned(64)));
+} ring;
+
+static ring rings[MAX_THREADS];
+
+static void *xmalloc_thread(void *arg)
+{
+    long self = (long)arg;
+    ring *r = &rings[self % num_threads];
+    if (self < num_threads)
+    {
+        // Producer
+        for (int i = 0; i < XMALLOC_OBJECTS; i++)
+        {
+            void *block = use->malloc(16 + (i % 16) * 32);
+            while (r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == XMALLOC_RING)
+                sched_yield();
+            r->slots[r->head % XMALLOC_RING] = block;
+            __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+        }
+    }
+    else
+    {
+        // Consumer
+        for (int i = 0; i < XMALLOC_OBJECTS; i++)
+        {
+            while (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == r->tail)
+                sched_yield();
+            use->free(r->slots[r->tail % XMALLOC_RING]);
+            __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+static long xmalloc()
+{
+    run_threads(xmalloc_thread, 2 * num_threads);
+    return 2L * XMALLOC_OBJECTS * num_threads;
+}
+
+/* cache-scratch */
+
+#define SCRATCH_ITERATIONS 20000
+#define SCRATCH_WRITES 500
+
+static void *scratch_blocks[MAX_THREADS];
+
+static void *scratch_thread(void *arg)
+{
+    long self = (long)arg;
+    use->free(scratch_blocks[self]);
+    for (int i = 0; i < SCRATCH_ITERATIONS; i++)
+    {
+        volatile char *block = use->malloc(8);
+        for (int j = 0; j < SCRATCH_WRITES; j++)
+            block[j % 8]++;
+        use->free((void *)block);
+    }
+    return NULL;
+}
+
+static long cache_scratch()
+{
+    for (int i = 0; i < num_threads; i++)
+        scratch_blocks[i] = use->malloc(8);
+    run_threads(scratch_thread, num_threads);
+    return (2L * SCRATCH_ITERATIONS + 1) * num_threads;
+}
+
+typedef struct benchmark {
+    const char *name;
+    long (*run)();
+} benchmark;
+
+static const benchmark benchmarks[] = {
+    { "larson", larson },
+    { "threadtest", threadtest },
+    { "xmalloc", xmalloc },
+    { "cache-scratch", cache_scratch },
+};
+
+#define ARRAY_LENGTH(array) (sizeof(array) / sizeof((array)[0]))
+
+/**
+ * @brief Runs one configuration in a child process and prints its line.
+ *
+ * @param b benchmark
+ * @param a allocator
+ * @param threads number of threads
+ */
+static void run(const benchmark *b, const allocator *a, int threads)
+{
+    int fds[2];
+    if (pipe(fds) == -1)
+        return;
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        close(fds[0]);
+        use = a;
+        num_threads = threads;
+        sf_mallopt(SF_OPT_HEAP_MAX, 1L << 30);
+        for (int i = 0; i < num_options; i++)
+            sf_mallopt(options[i][0], options[i][1]);
+
+        double start = now();
+        long ops = b->run();
+        double rate = ops / (now() - start);
+        if (write(fds[1], &rate, sizeof(rate)) != sizeof(rate))
+            exit(EXIT_FAILURE);
+        exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    double rate;
+    int valid = (read(fds[0], &rate, sizeof(rate)) == sizeof(rate));
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    wait4(child, &status, 0, &usage);
+    if (!valid || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+        printf("%-14s %-6s %7d %14s\n", b->name, a->name, threads, "failed");
+    else
+        printf("%-14s %-6s %7d %14.0f %12ld\n", b->name, a->name, threads, rate, usage.ru_maxrss);
+}
+
+int main(int argc, char *argv[])
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = (cpus > 0 && cpus < MAX_THREADS) ? cpus : MAX_THREADS;
+    const char *only = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:b:o:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > MAX_THREADS)
+                goto usage;
+            break;
+        case 'b':
+            only = optarg;
+            break;
+        case 'o':
+            if (num_options == MAX_OPTIONS ||
+                sscanf(optarg, "%ld=%ld", &options[num_options][0], &options[num_options][1]) != 2)
+                goto usage;
+            num_options++;
+            break;
+        default:
+            goto usage;
+        }
+    }
+
+    printf("%-14s %-6s %7s %14s %12s\n", "benchmark", "alloc", "threads", "ops/s", "max RSS KB");
+    for (size_t i = 0; i < ARRAY_LENGTH(benchmarks); i++)
+    {
+        if (only != NULL && strcmp(only, benchmarks[i].name) != 0)
+            continue;
+        for (int threads = 1; ; threads *= 2)
+        {
+            if (threads > max_threads)
+                threads = max_threads;
+            for (size_t j = 0; j < ARRAY_LENGTH(allocators); j++)
+                run(&benchmarks[i], &allocators[j], threads);
+            if (threads == max_threads)
+                break;
+        }
+    }
+    return EXIT_SUCCESS;
+
+usage:
+    fprintf(stderr, "usage: %s [-t max threads] [-b benchmark] [-o param=value]...\n", argv[0]);
+    return EXIT_FAILURE;
+}
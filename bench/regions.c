@@ -0,0 +1,84 @@
+/*
+ * Compares freeing objects one by one with freeing them all at once in a region, on
+ * requests that each allocate a number of small objects of random sizes and then drop
+ * them together. Every run gets a fresh heap in a child process.
+ *
+ * usage: bin/regions [requests] [objects per request]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "sfmm.h"
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void with_malloc(long requests, int objects)
+{
+    void **blocks = malloc(objects * sizeof(void *));
+    for (long r = 0; r < requests; r++)
+    {
+        for (int i = 0; i < objects; i++)
+        {
+            blocks[i] = sf_malloc(16 + rand() % 240);
+            memset(blocks[i], i, 16);
+        }
+        for (int i = 0; i < objects; i++)
+            sf_free(blocks[i]);
+    }
+    free(blocks);
+}
+
+static void with_region(long requests, int objects)
+{
+    sf_region *region = sf_region_create(0);
+    for (long r = 0; r < requests; r++)
+    {
+        for (int i = 0; i < objects; i++)
+            memset(sf_region_alloc(region, 16 + rand() % 240), i, 16);
+        sf_region_reset(region);
+    }
+    sf_region_destroy(region);
+}
+
+static void run(const char *name, void (*workload)(long, int), long requests, int objects)
+{
+    if (fork() != 0)
+    {
+        wait(NULL);
+        return;
+    }
+
+    sf_mallopt(SF_OPT_HEAP_MAX, 256 << 20);
+    srand(1);
+    double start = now();
+    workload(requests, objects);
+    double elapsed = now() - start;
+
+    printf("%-7s %10.0f requests/s %10.1f ns/object\n", name, requests / elapsed,
+           elapsed * 1e9 / ((double)requests * objects));
+    exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char const *argv[])
+{
+    long requests = (argc > 1) ? atol(argv[1]) : 20000;
+    int objects = (argc > 2) ? atoi(argv[2]) : 500;
+    if (requests < 1 || objects < 1)
+    {
+        fprintf(stderr, "usage: %s [requests] [objects per request]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    run("malloc", with_malloc, requests, objects);
+    run("region", with_region, requests, objects);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <pthread.h>
+#include "sfmm.h"
+#include "tree.h"
+#include "slab.h"
+#include "quick.h"
+
+/*
+ * An arena is an independent heap: its own free lists, its own region of memory
+ * (with a prologue and an epilogue) and its own lock.
+ *
+ * Arena 0 is the main arena. Its region is the one managed by sf_mem_grow() and its
+ * free lists are sf_free_list_heads. The other arenas live in a single reservation of
+ * (NUM_ARENAS_MAX - 1) * ARENA_HEAP_MAX bytes of address space, one slot per arena,
+ * taken from the backend of the main heap and committed one granule of that backend at
+ * a time as each arena grows, so with huge pages every slot is made of whole huge pages.
+ * The malloc backend does not give zeroed memory, so with it the slots come from mmap. This makes
+ * finding the arena that owns a block a matter of comparing its address against the
+ * two reservations.
+ *
+ * Each thread is assigned an arena round-robin on its first allocation. By default up to
+ * ARENAS_PER_CPU arenas are used per online CPU; see SF_OPT_ARENA_MAX. With
+ * SF_OPT_PERCPU_ARENAS, every allocation instead uses the arena of the CPU the thread
+ * runs on, so the number of arenas follows the number of cores however many threads
+ * come and go, and an arena's lock is only contended when a thread is preempted or
+ * migrates while holding it.
+ */
+#define NUM_ARENAS_MAX 64
+#define ARENAS_PER_CPU 2
+#define ARENA_HEAP_MAX ((size_t)1 << 26)
+
+/* Number of 64-bit words in the bitmap of non-empty free lists. */
+#define FREE_LIST_WORDS ((NUM_FREE_LISTS + 63) / 64)
+
+typedef struct sf_arena {
+    pthread_mutex_t lock;
+    sf_block *free_list_heads;
+    uint64_t nonempty[FREE_LIST_WORDS];
+    sf_block *tree_roots[NUM_TREE_CLASSES];
+    sf_slab *slabs[NUM_SLAB_CLASSES];
+    sf_block *quick_lists[QUICK_LISTS];
+    int quick_counts[QUICK_LISTS];
+    void *start;
+    void *end;
+    /* End of what the backend has committed, a granule boundary at or after end. */
+    void *committed;
+    /* Memory from here on has not been written since it was committed. */
+    void *dirty_end;
+    int index;
+    /* Pushed to without the lock, so it gets a cache line of its own. */
+    sf_block *remote_frees __attribute__((aligned(64)));
+} __attribute__((aligned(64))) sf_arena;
+
+extern sf_arena sf_arenas[NUM_ARENAS_MAX];
+#define main_arena (sf_arenas[0])
+
+sf_arena *arena_get();
+sf_arena *arena_current();
+sf_arena *arena_of(void *block);
+int arena_set_max(long count);
+
+void *arena_start(sf_arena *arena);
+void *arena_end(sf_arena *arena);
+void *arena_fresh(sf_arena *arena);
+void *arena_grow(sf_arena *arena, size_t pages);
+int arena_shrink(sf_arena *arena, size_t size);
+
+void arena_lock(sf_arena *arena);
+void arena_unlock(sf_arena *arena);
+void arena_lock_all();
+void arena_unlock_all();
+
+#endif /* ARENA_H */
@@ -0,0 +1,54 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+#include "sfmm.h"
+
+/*
+ * Sources of memory for the main heap (the one behind sf_mem_start(), sf_mem_end()
+ * and sf_mem_grow()) and for the reservation of the other arenas.
+ *
+ * A backend reserves the whole address range of the heap up front, so the heap never
+ * moves and stays contiguous. Pages at the end of the range are committed as the heap
+ * grows and decommitted as it shrinks, granularity bytes at a time, so a backend of huge
+ * pages always commits whole huge pages. If a backend cannot reserve the range, its
+ * fallback is tried instead. The backend and the maximum size of the heap can only be
+ * changed before the heap is first used; see SF_OPT_BACKEND and SF_OPT_HEAP_MAX.
+ */
+typedef struct sf_backend {
+    const char *name;
+    /* Unit of commits and of the reservation, a multiple of PAGE_SZ. */
+    size_t granularity;
+    /* Backend to use when this one cannot reserve the heap, or NULL. */
+    const struct sf_backend *fallback;
+    /* Reserves size bytes of address space, 64-byte aligned. NULL on failure. */
+    void *(*reserve)(size_t size);
+    /* Makes part of the reservation usable. 0 if successful, -1 otherwise. */
+    int (*commit)(void *addr, size_t size);
+    /* Gives committed pages back. 0 if successful, -1 otherwise. */
+    int (*decommit)(void *addr, size_t size);
+    /* Nonzero if newly committed and decommitted memory reads as zeros. */
+    int zeroed;
+} sf_backend;
+
+/* Reserves with mmap(PROT_NONE) and commits with mprotect. The default. */
+extern const sf_backend sf_mmap_backend;
+/* Takes the whole heap from malloc up front; committing is a no-op. */
+extern const sf_backend sf_malloc_backend;
+/* Like mmap, on a huge-page aligned range marked with madvise(MADV_HUGEPAGE). */
+extern const sf_backend sf_thp_backend;
+/* Maps the range from the hugetlbfs pool with MAP_HUGETLB; falls back to sf_thp_backend. */
+extern const sf_backend sf_hugetlb_backend;
+
+#define HUGE_PAGE_SZ ((size_t)2 << 20)
+
+/* Maximum size of the main heap unless SF_OPT_HEAP_MAX says otherwise. */
+#ifndef SF_HEAP_MAX_DEFAULT
+#define SF_HEAP_MAX_DEFAULT (16 * PAGE_SZ)
+#endif
+
+int sf_mem_set_backend(const sf_backend *backend);
+int sf_mem_set_max(size_t size);
+int sf_mem_shrink(size_t size);
+void *sf_mem_fresh();
+const sf_backend *sf_mem_backend();
+
+#endif /* BACKEND_H */
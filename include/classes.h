@@ -0,0 +1,63 @@
+/* Generated by tools/gen_classes.py, do not edit. */
+#ifndef CLASSES_H
+#define CLASSES_H
+
+/*
+ * Size-class schedules, chosen at build time with -DSF_CLASSES=SF_CLASSES_<name>
+ * (make CLASSES=<name>). Each free list but the last holds the blocks of at most
+ * CLASS_BOUNDS[i] * ALIGNMENT_SIZE bytes that are too large for the previous list;
+ * the last one holds all larger blocks. CLASS_LOOKUP gives the class of a block of
+ * n * ALIGNMENT_SIZE bytes for n up to CLASS_LOOKUP_UNITS.
+ */
+#define SF_CLASSES_FIBONACCI 0
+#define SF_CLASSES_POW2 1
+#define SF_CLASSES_GEOMETRIC 2
+
+#ifndef SF_CLASSES
+#define SF_CLASSES SF_CLASSES_FIBONACCI
+#endif
+
+#define CLASS_LOOKUP_UNITS 64
+
+#if SF_CLASSES == SF_CLASSES_FIBONACCI
+/* Fibonacci bounds (1, 2, 3, 5, 8, 13, 21, 34), the default. */
+#define NUM_FREE_LISTS 9
+#define CLASS_BOUNDS { \
+    1, 2, 3, 5, 8, 13, 21, 34, \
+}
+#define CLASS_LOOKUP { \
+    0, 0, 1, 2, 3, 3, 4, 4, 4, 5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 6, 7, 7, 7, 7, 7, 7, \
+    7, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, \
+    8, 8, 8, 8, 8, 8, 8, 8, 8, \
+}
+#elif SF_CLASSES == SF_CLASSES_POW2
+/* Powers of two up to 2^17 units. */
+#define NUM_FREE_LISTS 19
+#define CLASS_BOUNDS { \
+    1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536, \
+    131072, \
+}
+#define CLASS_LOOKUP { \
+    0, 0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, \
+    5, 5, 5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, \
+    6, 6, 6, 6, 6, 6, 6, 6, 6, \
+}
+#elif SF_CLASSES == SF_CLASSES_GEOMETRIC
+/* Exact up to 4 units, then 4 classes per doubling. */
+#define NUM_FREE_LISTS 64
+#define CLASS_BOUNDS { \
+    1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 16, 20, 24, 28, 32, 40, 48, 56, 64, 80, 96, 112, \
+    128, 160, 192, 224, 256, 320, 384, 448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, \
+    2048, 2560, 3072, 3584, 4096, 5120, 6144, 7168, 8192, 10240, 12288, 14336, 16384, \
+    20480, 24576, 28672, 32768, 40960, 49152, 57344, 65536, 81920, 98304, 114688, \
+}
+#define CLASS_LOOKUP { \
+    0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 12, 12, 13, 13, 13, \
+    13, 14, 14, 14, 14, 15, 15, 15, 15, 16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, \
+    17, 17, 17, 17, 18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19, 19, 19, 19, \
+}
+#else
+#error "Unknown SF_CLASSES schedule"
+#endif
+
+#endif /* CLASSES_H */
@@ -1,19 +1,26 @@
 #include "sfmm.h"
+#include "arena.h"
 
-int init_heap();
-void init_prologue();
-void init_epilogue();
-void init_freelists();
+int init_heap(sf_arena *arena);
+void init_prologue(sf_arena *arena);
+void init_epilogue(sf_arena *arena);
+void init_freelists(sf_arena *arena);
 
-int grow_heap();
-void coalesce(sf_block *block);
+sf_block *grow_heap(sf_arena *arena, size_t size);
+sf_block *coalesce(sf_block *block);
+size_t release_block(sf_block *block);
+void *released_pages_of(sf_block *block, void **end);
+size_t release_free_blocks(sf_arena *arena);
+size_t trim_heap(sf_arena *arena, size_t pad);
 
+int size_class(size_t block_size);
 void add_to_freelist(sf_block *block);
 void remove_from_freelist(sf_block *block);
-sf_block *get_remaining();
+sf_block *get_remaining(sf_arena *arena);
 
-sf_block *find_block(size_t block_size);
+sf_block *search_free_lists(sf_arena *arena, size_t block_size);
+sf_block *find_block(sf_arena *arena, size_t block_size);
+void place(sf_block *block, size_t size);
+sf_block *find_aligned_block(sf_arena *arena, size_t size, size_t align);
+int grow_in_place(sf_arena *arena, sf_block *block, size_t size);
 void split(sf_block *block, size_t size);
-
-
-int* fib_vals(int *a, int fib_count);
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+#include "sfmm.h"
+
+/*
+ * Large allocations mapped directly from the OS.
+ *
+ * Requests of at least SF_OPT_MMAP_THRESHOLD bytes get a mapping of their own instead of
+ * a block in an arena. The payload starts ALIGNMENT_SIZE bytes into the mapping and is
+ * preceded by a header holding the length of the mapping with the MAPPED_BLOCK and
+ * THIS_BLOCK_ALLOCATED bits set. Sizes are multiples of the OS page size, so the
+ * MAPPED_BLOCK bit is never set in the header of a block in an arena. The payloads of the
+ * live mappings are also kept in a set, which is what tells whether a pointer is mapped.
+ */
+#define MAPPED_BLOCK 0x4
+
+void *mapped_alloc(size_t size);
+int is_mapped(void *pp);
+void mapped_free(void *pp);
+void *mapped_realloc(void *pp, size_t size);
+size_t mapped_size(void *pp);
+void mapped_lock();
+void mapped_unlock();
+
+#endif /* MAPPED_H */
@@ -5,7 +5,7 @@
 #define ALIGNMENT_SIZE 64
 #define SIZE_MASK -4
 
-int get_size(sf_block *block);
+size_t get_size(sf_block *block);
 int is_free(sf_block *block);
 int is_prev_allocd(sf_block *block);
 
@@ -19,4 +19,7 @@ sf_block *get_prev_block(sf_block *block);
 
 void free_block(sf_block *freed_block);
 
+size_t align_size(size_t size);
+
+int validate_header(void *pointer);
 int validate_block(void* pointer);
\ No newline at end of file
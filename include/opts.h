@@ -0,0 +1,22 @@
+#ifndef OPTS_H
+#define OPTS_H
+#include <stddef.h>
+
+/*
+ * Current values of the options that can be changed with sf_mallopt().
+ * See sfmm.h for the meaning of each one.
+ */
+struct sf_options {
+    int tcache;
+    int slab;
+    size_t mmap_threshold;
+    size_t trim_threshold;
+    int defer_coalesce;
+    int remote_free;
+    int percpu_arenas;
+    size_t profile_rate;
+};
+
+extern struct sf_options sf_opts;
+
+#endif /* OPTS_H */
@@ -0,0 +1,56 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+#include <stddef.h>
+#include <stdint.h>
+#include "opts.h"
+
+/*
+ * Sampling heap profiler (SF_OPT_PROFILE_RATE).
+ *
+ * Each thread counts down the bytes it allocates from a distance drawn from an
+ * exponential distribution with a mean of the sampling rate, and records the backtrace
+ * of the allocation that crosses zero. Sampled blocks that are still allocated are kept in
+ * a hash table until they are freed, and sf_heap_profile_dump() writes them out. So that
+ * sf_free does not have to look every pointer up, a table of counters indexed by a hash
+ * of the address tells which pointers may be sampled.
+ */
+#define PROFILE_MAX_DEPTH 32
+#define PROFILE_MAX_SAMPLES 65536
+#define PROFILE_FILTER_SIZE 4096
+
+#define profile_hash(pp) ((size_t)(((uintptr_t)(pp) >> 4) * 0x9e3779b97f4a7c15ULL >> 40))
+
+extern __thread long profile_countdown;
+extern size_t profile_live;
+extern unsigned short profile_filter[PROFILE_FILTER_SIZE];
+
+void profile_sample(void *pp, size_t size);
+void profile_forget(void *pp);
+struct profile_entry *profile_detach(void *pp);
+void profile_reattach(struct profile_entry *entry);
+void profile_discard(struct profile_entry *entry);
+void profile_lock();
+void profile_unlock();
+
+/* Counts an allocation towards the next sample. */
+static inline void profile_malloc(void *pp, size_t size)
+{
+    if (sf_opts.profile_rate != 0 && (profile_countdown -= size) < 0)
+        profile_sample(pp, size);
+}
+
+/* Nonzero if the block may have a sample. */
+static inline int profile_tracked(void *pp)
+{
+    return __atomic_load_n(&profile_live, __ATOMIC_RELAXED) != 0 &&
+           __atomic_load_n(&profile_filter[profile_hash(pp) % PROFILE_FILTER_SIZE], __ATOMIC_RELAXED) != 0;
+}
+
+/* Drops the sample of a block being freed, if it has one. */
+static inline void profile_free(void *pp)
+{
+    if (profile_tracked(pp))
+        profile_forget(pp);
+}
+
+#endif /* PROFILE_H */
@@ -0,0 +1,27 @@
+#ifndef QUICK_H
+#define QUICK_H
+#include "sfmm.h"
+#include "mem.h"
+
+/*
+ * Quick lists for deferred coalescing (SF_OPT_DEFER_COALESCE).
+ *
+ * Each arena keeps one list per block size from ALIGNMENT_SIZE up to QUICK_MAX_SIZE.
+ * A freed block of such a size is pushed onto its list without being merged with its
+ * neighbours, and the next request for exactly that size pops it again. Listed blocks
+ * keep their allocated bit set, so neither coalesce() nor the heap walkers treat them as
+ * free, and are chained through body.links.next. The arena is consolidated (every listed
+ * block freed and coalesced in one pass) when find_block() would otherwise grow the heap
+ * and when a list grows past QUICK_LIST_MAX blocks.
+ */
+#define QUICK_LISTS 16
+#define QUICK_MAX_SIZE (QUICK_LISTS * ALIGNMENT_SIZE)
+#define QUICK_LIST_MAX 64
+
+struct sf_arena;
+
+sf_block *quick_get(struct sf_arena *arena, size_t size);
+int quick_put(struct sf_arena *arena, sf_block *block);
+int quick_consolidate(struct sf_arena *arena);
+
+#endif /* QUICK_H */
@@ -0,0 +1,32 @@
+#ifndef REGION_H
+#define REGION_H
+#include "sfmm.h"
+
+/*
+ * Regions for objects that are freed all at once.
+ *
+ * A region is a list of chunks, each an ordinary block allocated with sf_malloc(). Objects
+ * are handed out by advancing a cursor through the newest chunk and are never freed on
+ * their own; sf_region_reset() and sf_region_destroy() free the chunks instead, so tearing
+ * down a region costs one sf_free() per chunk however many objects it holds. The sf_region
+ * itself lives at the start of its first chunk, which is kept by sf_region_reset(). Objects
+ * larger than a quarter of a chunk get a chunk of their own, so that they do not waste the
+ * rest of the current one.
+ */
+#define REGION_CHUNK_SIZE (64 * 1024)
+#define REGION_CHUNK_MIN 1024
+#define REGION_ALIGN 16
+
+typedef struct sf_region_chunk {
+    struct sf_region_chunk *next;
+    size_t size;
+} sf_region_chunk;
+
+struct sf_region {
+    sf_region_chunk *chunks;    /* Chunks other than the first, newest first. */
+    char *cursor;
+    char *limit;
+    size_t chunk_size;
+};
+
+#endif /* REGION_H */
@@ -0,0 +1,21 @@
+#ifndef REMOTE_H
+#define REMOTE_H
+#include "sfmm.h"
+
+/*
+ * Remote-free queues for frees from other threads (SF_OPT_REMOTE_FREE).
+ *
+ * A block freed by a thread that is not assigned to the block's arena is pushed onto the
+ * arena's queue with a compare-and-swap instead of taking the arena lock, so the free
+ * never waits for the owner. Any number of threads push; the threads of the arena take
+ * the whole queue at once with an atomic exchange, so there is no ABA problem. Queued
+ * blocks keep their allocated bit and are chained through body.links.next. The queue is
+ * drained under the arena lock on every allocation from the arena, when find_block()
+ * misses and by sf_trim().
+ */
+struct sf_arena;
+
+void remote_push(struct sf_arena *arena, sf_block *block);
+int remote_drain(struct sf_arena *arena);
+
+#endif /* REMOTE_H */
@@ -32,16 +32,17 @@ typedef struct sf_block {
 } sf_block;
 
 /* sf_errno: will be set on error */
-int sf_errno;
+extern int sf_errno;
 
 /*
  * Free blocks are maintained in a set of circular, doubly linked lists, segregated by
- * size class.  The sizes increase according to a Fibonacci sequence (1, 2, 3, 5, 8, 13, ...).
- * The first list holds blocks of the minimum size M.  The second list holds blocks of size 2M.
- * The third list holds blocks of size 3M.  The fourth list holds blocks whose size is in the
- * interval (3M, 5M].  The fifth list holds blocks whose size is in the interval (5M, 8M],
- * and so on.  This continues up to the list at index NUM_FREE_LISTS-1 (i.e. 8), which
- * contains blocks whose size is greater than 34M.
+ * size class.  By default, the sizes increase according to a Fibonacci sequence (1, 2, 3, 5,
+ * 8, 13, ...).  The first list holds blocks of the minimum size M.  The second list holds
+ * blocks of size 2M.  The third list holds blocks of size 3M.  The fourth list holds blocks
+ * whose size is in the interval (3M, 5M].  The fifth list holds blocks whose size is in the
+ * interval (5M, 8M], and so on.  This continues up to the list at index NUM_FREE_LISTS-1
+ * (i.e. 8), which contains blocks whose size is greater than 34M.  Power-of-two and finer
+ * geometric schedules can be chosen at build time instead; see classes.h.
  *
  * Each of the circular, doubly linked lists has a "dummy" block used as the list header.
  * This dummy block is always linked between the last and the first element of the list.
@@ -53,8 +54,8 @@ int sf_errno;
  * and deletion of nodes from the list.
  */
 
-#define NUM_FREE_LISTS 9
-struct sf_block sf_free_list_heads[NUM_FREE_LISTS];
+#include "classes.h"
+extern struct sf_block sf_free_list_heads[NUM_FREE_LISTS];
 
 /*
  * Implementation of sf_malloc. It acquires uninitialized memory that
@@ -69,6 +70,22 @@ struct sf_block sf_free_list_heads[NUM_FREE_LISTS];
  */
 void *sf_malloc(size_t size);
 
+/*
+ * Allocates zeroed memory for an array of count elements of size bytes each.  Memory the
+ * heap has just grown into, pages of a free block that sf_trim() or SF_OPT_TRIM_THRESHOLD
+ * gave back with madvise, and mappings of SF_OPT_MMAP_THRESHOLD bytes or more, already
+ * read as zeros from the OS and are not cleared again, so large arrays only cost the pages
+ * that are actually touched.
+ *
+ * @param count The number of elements.
+ * @param size The size of each element.
+ *
+ * @return If count or size is 0, then NULL is returned without setting sf_errno.  If
+ * count * size overflows or the allocation is not successful, NULL is returned and
+ * sf_errno is set to ENOMEM.
+ */
+void *sf_calloc(size_t count, size_t size);
+
 /*
  * Resizes the memory pointed to by ptr to size bytes.
  *
@@ -86,6 +103,22 @@ void *sf_malloc(size_t size);
  */
 void *sf_realloc(void *ptr, size_t size);
 
+/*
+ * Allocates memory whose address is a multiple of align, such as 4 KB for page-sized
+ * buffers or 2 MB for buffers backed by huge pages.  The block is carved out of a larger
+ * free block; the memory before and after it goes back to the free lists.  It is freed
+ * and resized like any other block, but sf_realloc does not keep the alignment when it
+ * has to move the block.
+ *
+ * @param align The alignment in bytes, a power of two.
+ * @param size The number of bytes requested to be allocated.
+ *
+ * @return If size is 0, then NULL is returned without setting sf_errno.  If align is not
+ * a power of two, NULL is returned and sf_errno is set to EINVAL.  If the allocation is
+ * not successful, NULL is returned and sf_errno is set to ENOMEM.
+ */
+void *sf_memalign(size_t align, size_t size);
+
 /*
  * Marks a dynamically allocated region as no longer in use.
  * Adds the newly freed block to the free list.
@@ -96,6 +129,291 @@ void *sf_realloc(void *ptr, size_t size);
  */
 void sf_free(void *ptr);
 
+/*
+ * Like sf_free, for callers that know the size the block was requested with, such as C++
+ * sized delete.  Checking the header against the size replaces the checks of the
+ * neighbouring blocks that sf_free makes.
+ *
+ * @param ptr Address of memory returned by one of the allocation functions, or NULL.
+ * @param size The size passed when the block was allocated or last resized.
+ *
+ * If the block cannot have been allocated with that size, the function calls abort() to
+ * exit the program.
+ */
+void sf_free_sized(void *ptr, size_t size);
+
+/*
+ * Returns the number of bytes that can be used at ptr, which is at least the size it was
+ * requested with.  The payload of a block is rounded up to fill the block, so containers
+ * can grow into the difference without calling sf_realloc.
+ *
+ * @param ptr Address of memory returned by one of the allocation functions, or NULL.
+ *
+ * @return The usable size, or 0 if ptr is NULL.  If ptr is invalid, the function calls
+ * abort() to exit the program.
+ */
+size_t sf_malloc_usable_size(void *ptr);
+
+/*
+ * Allocates count blocks of size bytes each, as if by count calls to sf_malloc.  The blocks
+ * are carved one after another out of as few free blocks as possible, each taken from the
+ * free lists once, so a batch costs about as much as a single allocation.
+ *
+ * @param size The number of bytes requested for each block.
+ * @param count The number of blocks.
+ * @param out Array of count pointers that receives the blocks.
+ *
+ * @return The number of blocks allocated, stored in out[0] to out[n - 1].  If it is less
+ * than count (and count and size are nonzero), sf_errno is set to ENOMEM.
+ */
+size_t sf_malloc_batch(size_t size, size_t count, void **out);
+
+/*
+ * Frees count blocks, as if by count calls to sf_free.  The pointers are sorted by address,
+ * so that blocks next to each other in the heap are merged into one free block and
+ * coalesced once, and each arena is locked once per run of its blocks.  NULL pointers are
+ * skipped.
+ *
+ * @param ptrs Array of count pointers returned by the allocation functions.  Its order is
+ * not preserved.
+ * @param count The number of pointers.
+ *
+ * If any pointer is invalid or appears twice, the function calls abort() to exit the
+ * program.
+ */
+void sf_free_batch(void **ptrs, size_t count);
+
+/*
+ * Options that can be changed with sf_mallopt().
+ *
+ * SF_OPT_TCACHE: If nonzero, each thread keeps a cache of recently freed small blocks
+ * and serves allocations of the same size from it without touching the free lists.
+ * Cached blocks are only returned to the free lists in batches, so they are not coalesced
+ * while cached.  Setting it back to 0 flushes the cache of the calling thread only; the
+ * other threads stop caching, and their caches are flushed when they exit.  Disabled by
+ * default.
+ */
+#define SF_OPT_TCACHE 1
+
+/*
+ * SF_OPT_ARENA_MAX: The number of independent arenas (heaps with their own free lists and
+ * lock) that threads are spread over.  Each thread is assigned an arena on its first
+ * allocation and blocks are always freed back to the arena they were allocated from.
+ * 0 (the default) means twice the number of online CPUs, 1 makes every thread share the
+ * main arena.  Only affects threads that have not allocated yet, except with
+ * SF_OPT_PERCPU_ARENAS.
+ */
+#define SF_OPT_ARENA_MAX 2
+
+/*
+ * SF_OPT_SLAB: If nonzero, requests of at most 48 bytes are served from slabs that pack
+ * objects of 8, 16, 32 or 48 bytes into pages carved from the heap, instead of taking a
+ * full minimum-size block each.  Such objects are only 8 to 16 byte aligned.  Disabled by
+ * default.
+ */
+#define SF_OPT_SLAB 3
+
+/*
+ * SF_OPT_MMAP_THRESHOLD: Requests of at least this many bytes get a memory mapping of
+ * their own instead of a block in the heap.  sf_free unmaps it and sf_realloc resizes it
+ * with mremap, so large buffers never fragment the heap.  0 (the default) disables this.
+ */
+#define SF_OPT_MMAP_THRESHOLD 4
+
+/*
+ * SF_OPT_TRIM_THRESHOLD: When a block of at least this many bytes is freed, the memory is
+ * given back to the OS: the heap shrinks if the coalesced block is the last one, otherwise
+ * the whole pages inside it are released with madvise.  0 (the default) disables this;
+ * sf_trim() can still be called explicitly.
+ */
+#define SF_OPT_TRIM_THRESHOLD 5
+
+/*
+ * SF_OPT_HEAP_MAX: The maximum size in bytes of the main heap, rounded up to whole pages.
+ * Its address range is reserved in full when the heap is first used, so this can only be
+ * set before the first allocation.  Defaults to 16 pages.
+ */
+#define SF_OPT_HEAP_MAX 6
+
+/*
+ * SF_OPT_BACKEND: Where the main heap gets its memory from.  SF_BACKEND_MMAP (the default)
+ * reserves the range with mmap and commits pages as the heap grows, so an unused maximum
+ * costs nothing and pages are given back to the OS when the heap shrinks.  SF_BACKEND_MALLOC
+ * takes the whole range from malloc up front, which is what tests and tools that replace
+ * mmap expect.  SF_BACKEND_THP and SF_BACKEND_HUGETLB back the heap with 2 MB huge pages,
+ * which cuts TLB misses on large heaps: the range is aligned to and committed in whole
+ * huge pages, either transparent ones (madvise(MADV_HUGEPAGE)) or ones from the hugetlbfs
+ * pool (MAP_HUGETLB).  When the pool cannot hold SF_OPT_HEAP_MAX bytes, SF_BACKEND_HUGETLB
+ * falls back to transparent huge pages, which in turn degrade to regular pages when the
+ * kernel has none.  The heaps of the other arenas get their address space from the same
+ * backend, and commit it in the same units, except with SF_BACKEND_MALLOC, which leaves
+ * them on mmap.  Can only be set before the first allocation.
+ */
+#define SF_OPT_BACKEND 7
+#define SF_BACKEND_MMAP 0
+#define SF_BACKEND_MALLOC 1
+#define SF_BACKEND_THP 2
+#define SF_BACKEND_HUGETLB 3
+
+/*
+ * SF_OPT_DEFER_COALESCE: If nonzero, freed blocks of at most 1024 bytes are put on per-size
+ * quick lists of their arena instead of being coalesced, and a request for the same size
+ * takes them back without searching the free lists.  They are coalesced in bulk when no
+ * free block fits a request or a quick list grows long.  Setting it back to 0 coalesces
+ * every listed block.  Disabled by default.
+ */
+#define SF_OPT_DEFER_COALESCE 8
+
+/*
+ * SF_OPT_REMOTE_FREE: If nonzero, a block freed by a thread assigned to another arena than
+ * the block's is pushed onto a lock-free queue of that arena instead of waiting for its
+ * lock.  The threads of the arena free the queued blocks in one batch on their next
+ * allocation.  Double frees of queued blocks are not detected.  Setting it back to 0 frees
+ * every queued block.  Disabled by default.
+ */
+#define SF_OPT_REMOTE_FREE 9
+
+/*
+ * SF_OPT_PERCPU_ARENAS: If nonzero, every allocation uses the arena of the CPU the calling
+ * thread runs on, found through restartable sequences (rseq) or sched_getcpu(), instead
+ * of an arena assigned to the thread.  Memory then grows with the number of cores rather
+ * than the number of threads.  CPUs are spread over SF_OPT_ARENA_MAX arenas if it is set.
+ * Combined with SF_OPT_REMOTE_FREE, blocks freed on another CPU than their arena's are
+ * queued.  Disabled by default.
+ */
+#define SF_OPT_PERCPU_ARENAS 10
+
+/*
+ * SF_OPT_PROFILE_RATE: If nonzero, the average number of bytes allocated between two
+ * allocations whose backtrace is recorded by the heap profiler.  The sampled blocks that
+ * are still allocated can be written out with sf_heap_profile_dump().  A rate of 512 KB
+ * samples few enough allocations to be left on.  0 (the default) stops sampling; blocks
+ * sampled before are still tracked until they are freed.
+ */
+#define SF_OPT_PROFILE_RATE 11
+
+/*
+ * Sets an allocator option to the given value.
+ *
+ * @param param One of the SF_OPT_* options.
+ * @param value The new value of the option.
+ *
+ * @return 1 if successful, 0 if param is not a valid option, in which case sf_errno
+ * is set to EINVAL.
+ */
+int sf_mallopt(int param, long value);
+
+/*
+ * Gives free memory back to the OS.  In every arena, the heap is shrunk when its last
+ * block is free, keeping pad bytes of that block, and the whole pages inside the other
+ * large free blocks are released with madvise(MADV_DONTNEED).  Blocks cached by the calling
+ * thread are freed first.
+ *
+ * @param pad The number of free bytes to leave at the end of each heap.
+ *
+ * @return 1 if any memory was released, 0 otherwise.
+ */
+int sf_trim(size_t pad);
+
+/*
+ * Statistics of the allocator, filled in by sf_get_stats().  Sizes are in bytes and
+ * include block headers.
+ */
+struct sf_stats {
+    size_t mallocs;               /* Successful allocations, by any function. */
+    size_t frees;                 /* Blocks freed, including by sf_realloc(ptr, 0). */
+    size_t reallocs_in_place;     /* sf_realloc calls that grew a block where it was. */
+    size_t reallocs_copied;       /* sf_realloc calls that moved a block. */
+    size_t heap_grows;            /* Times a heap grew, if only by part of what was needed. */
+    size_t heap_bytes;            /* Size of the heaps of all arenas. */
+    size_t in_use_bytes;          /* Allocated blocks in the heaps. */
+    size_t mapped_bytes;          /* Allocations mapped on their own (SF_OPT_MMAP_THRESHOLD). */
+    size_t quick_bytes;           /* Freed blocks on quick lists (SF_OPT_DEFER_COALESCE). */
+    size_t free_bytes;            /* Free blocks in the heaps. */
+    size_t free_bytes_per_class[NUM_FREE_LISTS];
+    size_t largest_free_block;
+    double fragmentation;         /* 1 - largest_free_block / free_bytes, 0 with no free blocks. */
+};
+
+/*
+ * Gets the statistics of the allocator.  The counters are cheap enough to be always on:
+ * each thread adds its allocations and frees to the totals in batches, so the counts of
+ * other threads can lag by a few dozen operations.  The byte counts come from a walk of
+ * every heap, taking each arena lock in turn, so they cost time proportional to the
+ * number of blocks.  Blocks in thread caches (SF_OPT_TCACHE) count as in use.
+ *
+ * @param stats Filled in with the statistics.
+ */
+void sf_get_stats(struct sf_stats *stats);
+
+/*
+ * Writes statistics as a JSON object, with one member per field of struct sf_stats.
+ *
+ * @param stats Statistics from sf_get_stats().
+ * @param buf Buffer for the text, NUL-terminated if size is nonzero.
+ * @param size Size of the buffer.
+ *
+ * @return The length of the text, which was truncated if it is size or more, as with
+ * snprintf.
+ */
+int sf_stats_json(const struct sf_stats *stats, char *buf, size_t size);
+
+/*
+ * A region hands out objects that are all freed together.  It takes chunks of memory
+ * from the heap with sf_malloc and carves objects out of them by advancing a pointer, so
+ * allocating from a region and tearing it down cost a few instructions per object and
+ * one sf_free per chunk.  Objects are 16-byte aligned.  A region must not be used by
+ * several threads at once.
+ */
+typedef struct sf_region sf_region;
+
+/*
+ * Creates a region.
+ *
+ * @param chunk_size The size of the chunks taken from the heap, 0 for 64 KB.
+ *
+ * @return The region, or NULL with sf_errno set to ENOMEM.
+ */
+sf_region *sf_region_create(size_t chunk_size);
+
+/*
+ * Allocates an object from a region.  It cannot be passed to sf_free or sf_realloc.
+ *
+ * @param region A region from sf_region_create().
+ * @param size The number of bytes requested.
+ *
+ * @return The object, NULL if size is 0 or, with sf_errno set to ENOMEM, if the region
+ * could not grow.
+ */
+void *sf_region_alloc(sf_region *region, size_t size);
+
+/*
+ * Frees every object of a region at once.  The first chunk is kept for the objects
+ * allocated next, the others go back to the heap.
+ *
+ * @param region A region from sf_region_create().
+ */
+void sf_region_reset(sf_region *region);
+
+/*
+ * Frees every object of a region and the region itself.  Does nothing if region is NULL.
+ *
+ * @param region A region from sf_region_create().
+ */
+void sf_region_destroy(sf_region *region);
+
+/*
+ * Writes the blocks sampled by the heap profiler (SF_OPT_PROFILE_RATE) that are still
+ * allocated, with the backtraces of their allocations, in the heap profile format of
+ * gperftools, which pprof reads: pprof <program> <file>.  The sizes are those of the
+ * sampled blocks; pprof scales them up by the sampling rate.
+ *
+ * @param fd File descriptor to write to.
+ *
+ * @return 0 if successful, -1 if writing failed.
+ */
+int sf_heap_profile_dump(int fd);
+
 /* sfutil.c: Helper functions. */
 
 /*
@@ -110,7 +428,7 @@ void *sf_mem_end();
 
 /*
  * This function increases the size of the heap by adding one page of
- * memory to the end.
+ * memory to the end, committed by the backend selected with SF_OPT_BACKEND.
  *
  * @return On success, this function returns a pointer to the start of the
  * additional page, which is the same as the value that would have been returned
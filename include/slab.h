@@ -0,0 +1,37 @@
+#ifndef SLAB_H
+#define SLAB_H
+#include "sfmm.h"
+
+/*
+ * Slabs for tiny objects.
+ *
+ * Requests of at most SLAB_MAX_OBJECT bytes are rounded up to one of the slab object
+ * sizes (8, 16, 32 or 48 bytes) and packed into slabs: blocks whose payload is a
+ * SLAB_SIZE-aligned run of SLAB_SIZE bytes, carved from the arena's heap. Each slab starts
+ * with an sf_slab header holding a bitmap of its free objects, so the slab owning an object
+ * is found by rounding the object's address down to SLAB_SIZE. Freeing an object only sets
+ * its bit; the slab goes back to the free lists once all of its objects are free and it is
+ * not the last slab of its size in the arena.
+ */
+#define SLAB_SIZE 4096
+#define SLAB_MAX_OBJECT 48
+#define NUM_SLAB_CLASSES 4
+#define SLAB_MAP_WORDS (SLAB_SIZE / 8 / 64)
+
+typedef struct sf_slab {
+    uint64_t magic;
+    struct sf_slab *self;
+    struct sf_slab *next;
+    struct sf_slab *prev;
+    unsigned int object_size;
+    unsigned int num_objects;
+    unsigned int num_free;
+    unsigned int slab_class;
+    uint64_t free_map[SLAB_MAP_WORDS];
+} sf_slab;
+
+void *slab_alloc(size_t size);
+sf_slab *slab_of(void *pp);
+void slab_free(sf_slab *slab, void *pp);
+
+#endif /* SLAB_H */
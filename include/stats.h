@@ -0,0 +1,52 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stddef.h>
+
+/*
+ * Event counters kept by the allocator. They are updated with relaxed
+ * atomic increments so that they can be bumped without holding a lock.
+ */
+struct sf_counters {
+    size_t realloc_in_place;
+    size_t realloc_copied;
+    size_t calloc_fresh_bytes;
+    size_t heap_grows;
+    size_t mapped_bytes;
+    size_t mallocs;
+    size_t frees;
+};
+
+extern struct sf_counters sf_counters;
+
+#define sf_count(counter) __atomic_fetch_add(&sf_counters.counter, 1, __ATOMIC_RELAXED)
+#define sf_count_add(counter, n) __atomic_fetch_add(&sf_counters.counter, (n), __ATOMIC_RELAXED)
+#define sf_count_sub(counter, n) __atomic_fetch_sub(&sf_counters.counter, (n), __ATOMIC_RELAXED)
+
+/*
+ * Allocations and frees happen too often for every thread to bump the same cache line,
+ * so each thread counts them on its own and adds them to sf_counters once it has counted
+ * STATS_BATCH of them, when it asks for the statistics, or when it exits.
+ */
+#define STATS_BATCH 64
+
+struct sf_thread_counters {
+    size_t mallocs;
+    size_t frees;
+    size_t pending;
+    int registered;
+};
+
+extern __thread struct sf_thread_counters sf_thread_counters;
+
+void stats_flush();
+void stats_register();
+
+#define stats_count(counter, n) do { \
+        if (!sf_thread_counters.registered) \
+            stats_register(); \
+        sf_thread_counters.counter += (n); \
+        if ((sf_thread_counters.pending += (n)) >= STATS_BATCH) \
+            stats_flush(); \
+    } while (0)
+
+#endif /* STATS_H */
@@ -0,0 +1,26 @@
+#ifndef TCACHE_H
+#define TCACHE_H
+#include "sfmm.h"
+#include "mem.h"
+
+/*
+ * Per-thread cache of recently freed small blocks.
+ *
+ * Each thread keeps one bin per block size from ALIGNMENT_SIZE up to
+ * TCACHE_MAX_SIZE. Cached blocks keep their allocated bit set, so they are
+ * never coalesced, and are chained through body.links.next. A bin is refilled
+ * with TCACHE_FILL_COUNT blocks from the free lists under a single lock
+ * acquisition, and when it holds more than TCACHE_BIN_MAX blocks the oldest
+ * TCACHE_FLUSH_COUNT are freed back to the free lists in one go.
+ */
+#define TCACHE_BINS 16
+#define TCACHE_MAX_SIZE (TCACHE_BINS * ALIGNMENT_SIZE)
+#define TCACHE_FILL_COUNT 8
+#define TCACHE_BIN_MAX 32
+#define TCACHE_FLUSH_COUNT 16
+
+sf_block *tcache_get(size_t size);
+int tcache_put(sf_block *block);
+void tcache_flush_all();
+
+#endif /* TCACHE_H */
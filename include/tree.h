@@ -0,0 +1,24 @@
+#ifndef TREE_H
+#define TREE_H
+#include "sfmm.h"
+
+/*
+ * Free blocks in the size classes from TREE_MIN_CLASS up are kept in a size-ordered
+ * tree as well as in their free list, so that a best-fit block can be found in
+ * O(log n) instead of walking the list.
+ *
+ * The tree is a treap ordered by (size, address), with each block's priority derived
+ * from a hash of its address. The left and right links are stored in the body of the
+ * free block, right after the free list links.
+ */
+#define TREE_MIN_CLASS (NUM_FREE_LISTS - 1)
+#define NUM_TREE_CLASSES (NUM_FREE_LISTS - TREE_MIN_CLASS)
+
+/* Bytes at the start of a free block's body taken by its free list and tree links. */
+#define FREE_LINKS_SIZE (sizeof(((sf_block *)0)->body.links) + 2 * sizeof(sf_block *))
+
+sf_block *tree_insert(sf_block *root, sf_block *block);
+sf_block *tree_remove(sf_block *root, sf_block *block);
+sf_block *tree_best_fit(sf_block *root, size_t size);
+
+#endif /* TREE_H */
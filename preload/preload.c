@@ -0,0 +1,268 @@
+/*
+ * Drop-in replacement for the libc allocator, built as bin/libsfmm.so:
+ *
+ *   LD_PRELOAD=bin/libsfmm.so program
+ *
+ * Exports the malloc family on top of sf_malloc and friends. The allocator is set up on
+ * the first call, which may come from the dynamic loader or libc before any constructor
+ * has run, so nothing here allocates or relies on initialization order. The options
+ * below are read from the environment at that point:
+ *
+ *   SFMM_HEAP_MAX           SF_OPT_HEAP_MAX (default PRELOAD_HEAP_MAX)
+ *   SFMM_MMAP_THRESHOLD     SF_OPT_MMAP_THRESHOLD (default PRELOAD_MMAP_THRESHOLD)
+ *   SFMM_TRIM_THRESHOLD     SF_OPT_TRIM_THRESHOLD
+ *   SFMM_ARENA_MAX          SF_OPT_ARENA_MAX
+ *   SFMM_TCACHE             SF_OPT_TCACHE
+ *   SFMM_SLAB               SF_OPT_SLAB
+ *   SFMM_DEFER_COALESCE     SF_OPT_DEFER_COALESCE
+ *   SFMM_REMOTE_FREE        SF_OPT_REMOTE_FREE
+ *   SFMM_PERCPU_ARENAS      SF_OPT_PERCPU_ARENAS
+ *   SFMM_PROFILE_RATE       SF_OPT_PROFILE_RATE
+ *   SFMM_BACKEND            mmap, thp or hugetlb
+ *   SFMM_STATS              if set, sf_get_stats() is written to stderr as JSON at exit
+ *   SFMM_PROFILE            file sf_heap_profile_dump() writes to at exit
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sfmm.h"
+#include "arena.h"
+#include "profile.h"
+#include "mapped.h"
+
+#define PRELOAD_HEAP_MAX ((long)1 << 36)
+#define PRELOAD_MMAP_THRESHOLD (128 * 1024)
+
+static pthread_once_t preload_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Reads a numeric option from the environment.
+ *
+ * @param name environment variable
+ * @param value set to the value of the variable if it is a number
+ * @return int 1 if the variable holds a number, 0 otherwise
+ */
+static int env_option(const char *name, long *value)
+{
+    const char *text = getenv(name);
+    if (text == NULL || *text == '\0')
+        return 0;
+
+    char *end;
+    long parsed = strtol(text, &end, 0);
+    if (*end != '\0')
+        return 0;
+    *value = parsed;
+    return 1;
+}
+
+static void preload_setup()
+{
+    long value = PRELOAD_HEAP_MAX;
+    env_option("SFMM_HEAP_MAX", &value);
+    sf_mallopt(SF_OPT_HEAP_MAX, value);
+
+    value = PRELOAD_MMAP_THRESHOLD;
+    env_option("SFMM_MMAP_THRESHOLD", &value);
+    sf_mallopt(SF_OPT_MMAP_THRESHOLD, value);
+
+    if (env_option("SFMM_TRIM_THRESHOLD", &value))
+        sf_mallopt(SF_OPT_TRIM_THRESHOLD, value);
+    if (env_option("SFMM_ARENA_MAX", &value))
+        sf_mallopt(SF_OPT_ARENA_MAX, value);
+    if (env_option("SFMM_TCACHE", &value))
+        sf_mallopt(SF_OPT_TCACHE, value);
+    if (env_option("SFMM_SLAB", &value))
+        sf_mallopt(SF_OPT_SLAB, value);
+    if (env_option("SFMM_DEFER_COALESCE", &value))
+        sf_mallopt(SF_OPT_DEFER_COALESCE, value);
+    if (env_option("SFMM_REMOTE_FREE", &value))
+        sf_mallopt(SF_OPT_REMOTE_FREE, value);
+    if (env_option("SFMM_PERCPU_ARENAS", &value))
+        sf_mallopt(SF_OPT_PERCPU_ARENAS, value);
+    if (env_option("SFMM_PROFILE_RATE", &value))
+        sf_mallopt(SF_OPT_PROFILE_RATE, value);
+
+    // The malloc backend would call back into this library
+    const char *backend = getenv("SFMM_BACKEND");
+    if (backend == NULL)
+        return;
+    if (strcmp(backend, "thp") == 0)
+        sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_THP);
+    else if (strcmp(backend, "hugetlb") == 0)
+        sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_HUGETLB);
+}
+
+static inline void preload_init()
+{
+    pthread_once(&preload_once, preload_setup);
+}
+
+static void preload_print_stats()
+{
+    struct sf_stats stats;
+    char json[1024];
+    sf_get_stats(&stats);
+    int length = sf_stats_json(&stats, json, sizeof(json) - 1);
+    if (length > (int)sizeof(json) - 2)
+        length = sizeof(json) - 2;
+    json[length++] = '\n';
+    if (write(STDERR_FILENO, json, length) != length)
+        return;
+}
+
+static void preload_dump_profile()
+{
+    int fd = open(getenv("SFMM_PROFILE"), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        return;
+    sf_heap_profile_dump(fd);
+    close(fd);
+}
+
+static void preload_prefork()
+{
+    profile_lock();
+    mapped_lock();
+    arena_lock_all();
+}
+
+static void preload_postfork()
+{
+    arena_unlock_all();
+    mapped_unlock();
+    profile_unlock();
+}
+
+/* Keeps fork() from handing the child an arena, the mappings or the profile locked by another thread. */
+__attribute__((constructor)) static void preload_register()
+{
+    pthread_atfork(preload_prefork, preload_postfork, preload_postfork);
+    if (getenv("SFMM_STATS") != NULL)
+        atexit(preload_print_stats);
+    if (getenv("SFMM_PROFILE") != NULL)
+        atexit(preload_dump_profile);
+}
+
+void *malloc(size_t size)
+{
+    preload_init();
+    void *pp = sf_malloc(size == 0 ? 1 : size);
+    if (pp == NULL)
+        errno = ENOMEM;
+    return pp;
+}
+
+void free(void *ptr)
+{
+    if (ptr != NULL)
+        sf_free(ptr);
+}
+
+/* C23 */
+void free_sized(void *ptr, size_t size)
+{
+    sf_free_sized(ptr, size == 0 ? 1 : size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    if (count == 0 || size == 0)
+        return malloc(0);
+
+    preload_init();
+    void *pp = sf_calloc(count, size);
+    if (pp == NULL)
+        errno = ENOMEM;
+    return pp;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return malloc(size);
+    if (size == 0)
+    {
+        sf_free(ptr);
+        return NULL;
+    }
+    void *pp = sf_realloc(ptr, size);
+    if (pp == NULL)
+        errno = ENOMEM;
+    return pp;
+}
+
+void *reallocarray(void *ptr, size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, count * size);
+}
+
+static void *aligned_malloc(size_t align, size_t size)
+{
+    preload_init();
+    void *pp = sf_memalign(align, size == 0 ? 1 : size);
+    if (pp == NULL)
+        errno = ENOMEM;
+    return pp;
+}
+
+static int valid_alignment(size_t align)
+{
+    return align != 0 && (align & (align - 1)) == 0;
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    if (!valid_alignment(align) || align % sizeof(void *) != 0)
+        return EINVAL;
+    void *pp = aligned_malloc(align, size);
+    if (pp == NULL)
+        return ENOMEM;
+    *memptr = pp;
+    return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    if (!valid_alignment(align))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    return aligned_malloc(align, size);
+}
+
+void *memalign(size_t align, size_t size)
+{
+    if (!valid_alignment(align))
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+    return aligned_malloc(align, size);
+}
+
+void *valloc(size_t size)
+{
+    return aligned_malloc(sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    return aligned_malloc(page, (size + page - 1) / page * page);
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    return sf_malloc_usable_size(ptr);
+}
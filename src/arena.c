@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#if defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define HAVE_RSEQ
+#endif
+#endif
+#include "sfmm.h"
+#include "mem.h"
+#include "heap.h"
+#include "arena.h"
+#include "backend.h"
+#include "opts.h"
+#include "debug.h"
+
+sf_arena sf_arenas[NUM_ARENAS_MAX] = {
+    [0] = { .lock = PTHREAD_MUTEX_INITIALIZER, .free_list_heads = sf_free_list_heads }
+};
+
+static sf_block arena_free_lists[NUM_ARENAS_MAX][NUM_FREE_LISTS];
+
+/* Reservation holding the regions of arenas 1 .. NUM_ARENAS_MAX-1, and where it came from. */
+static void *arenas_base;
+static const sf_backend *arenas_backend;
+#define ARENAS_RESERVED ((NUM_ARENAS_MAX - 1) * ARENA_HEAP_MAX)
+
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER;
+static int arena_max;
+static unsigned int next_arena;
+
+static __thread sf_arena *thread_arena;
+
+/**
+ * @brief Sets up an arena other than the main one the first time
+ * a thread is assigned to it. Its heap is created on first allocation.
+ * 
+ * @param index index of the arena
+ * @return int 0 if successful
+ *             -1 if the address space could not be reserved
+ */
+static int arena_setup(int index)
+{
+    sf_arena *arena = &sf_arenas[index];
+    int status = 0;
+
+    pthread_mutex_lock(&arenas_lock);
+    if (arena->free_list_heads != NULL)
+    {
+        pthread_mutex_unlock(&arenas_lock);
+        return 0;
+    }
+    if (arenas_base == NULL)
+    {
+        // Heaps of arenas count on newly committed memory reading as zeros
+        const sf_backend *backend = sf_mem_backend();
+        if (backend == NULL || !backend->zeroed)
+            backend = &sf_mmap_backend;
+
+        void *base = NULL;
+        for (; backend != NULL; backend = backend->fallback)
+        {
+            base = backend->reserve(ARENAS_RESERVED);
+            if (base != NULL)
+                break;
+        }
+        if (base == NULL)
+            status = -1;
+        else
+        {
+            arenas_backend = backend;
+            __atomic_store_n(&arenas_base, base, __ATOMIC_RELEASE);
+        }
+    }
+    if (status == 0)
+    {
+        pthread_mutex_init(&arena->lock, NULL);
+        arena->start = arenas_base + (index - 1) * ARENA_HEAP_MAX;
+        arena->end = arena->start;
+        arena->committed = arena->start;
+        arena->dirty_end = arena->start;
+        arena->index = index;
+        __atomic_store_n(&arena->free_list_heads, arena_free_lists[index], __ATOMIC_RELEASE);
+        debug("arena %d at %p", index, arena->start);
+    }
+    pthread_mutex_unlock(&arenas_lock);
+    return status;
+}
+
+/**
+ * @brief Number of arenas threads are spread over.
+ * 
+ * @return int 
+ */
+static int arena_count()
+{
+    int count = __atomic_load_n(&arena_max, __ATOMIC_RELAXED);
+    if (count == 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = (cpus > 0) ? cpus * ARENAS_PER_CPU : 1;
+        count = (count > NUM_ARENAS_MAX) ? NUM_ARENAS_MAX : count;
+    }
+    return count;
+}
+
+/**
+ * @brief Limits the number of arenas used for threads that have
+ * not allocated yet.
+ * 
+ * @param count number of arenas, 0 for the default
+ * @return int 1 if successful, 0 if count is out of range
+ */
+int arena_set_max(long count)
+{
+    if (count < 0 || count > NUM_ARENAS_MAX)
+        return 0;
+    __atomic_store_n(&arena_max, (int)count, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/**
+ * @brief Number of the CPU the calling thread runs on. It is read from
+ * the restartable sequences area glibc registers for every thread,
+ * which the kernel updates whenever the thread migrates, so this costs
+ * a load instead of a system call. Without rseq, sched_getcpu() is used.
+ * 
+ * @return int 
+ */
+static int current_cpu()
+{
+#ifdef HAVE_RSEQ
+    if (__rseq_size > 0)
+    {
+        struct rseq *area = (struct rseq *)((char *)__builtin_thread_pointer() + __rseq_offset);
+        int cpu = (int)__atomic_load_n(&area->cpu_id, __ATOMIC_RELAXED);
+        if (cpu >= 0)
+            return cpu;
+    }
+#endif
+    int cpu = sched_getcpu();
+    return (cpu < 0) ? 0 : cpu;
+}
+
+/**
+ * @brief Gets the arena of the CPU the calling thread runs on, one per
+ * CPU up to NUM_ARENAS_MAX or SF_OPT_ARENA_MAX. CPU 0 uses the main
+ * arena. Falls back to the main arena if the CPU's arena cannot be
+ * set up.
+ * 
+ * @return sf_arena* 
+ */
+static sf_arena *cpu_arena()
+{
+    int count = __atomic_load_n(&arena_max, __ATOMIC_RELAXED);
+    int index = current_cpu() % ((count != 0) ? count : NUM_ARENAS_MAX);
+    sf_arena *arena = &sf_arenas[index];
+    if (__atomic_load_n(&arena->free_list_heads, __ATOMIC_ACQUIRE) == NULL && arena_setup(index) == -1)
+        return &main_arena;
+    return arena;
+}
+
+/**
+ * @brief Gets the arena of the calling thread, assigning one
+ * round-robin on the first call. Falls back to the main arena if
+ * a new arena cannot be set up. Allocations made while the arena is
+ * being assigned use the main arena. With SF_OPT_PERCPU_ARENAS, gets
+ * the arena of the current CPU instead.
+ * 
+ * @return sf_arena* 
+ */
+sf_arena *arena_get()
+{
+    if (sf_opts.percpu_arenas)
+        return cpu_arena();
+    if (thread_arena != NULL)
+        return thread_arena;
+
+    // sysconf() may allocate, which must not recurse into assigning an arena
+    thread_arena = &main_arena;
+    int index = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % arena_count();
+    if (index != 0 && arena_setup(index) == -1)
+        index = 0;
+
+    thread_arena = &sf_arenas[index];
+    return thread_arena;
+}
+
+/**
+ * @brief Gets the arena of the calling thread without assigning one.
+ * With SF_OPT_PERCPU_ARENAS, gets the arena of the current CPU.
+ * 
+ * @return sf_arena* NULL if the thread has not allocated yet
+ */
+sf_arena *arena_current()
+{
+    if (sf_opts.percpu_arenas)
+        return cpu_arena();
+    return thread_arena;
+}
+
+/**
+ * @brief Finds the arena whose heap contains the given address.
+ * 
+ * @param block address of a block
+ * @return sf_arena* owning arena, NULL if the address is in no heap
+ */
+sf_arena *arena_of(void *block)
+{
+    if (block >= sf_mem_start() && block < sf_mem_end())
+        return &main_arena;
+
+    void *base = __atomic_load_n(&arenas_base, __ATOMIC_ACQUIRE);
+    if (base == NULL || block < base || block >= base + ARENAS_RESERVED)
+        return NULL;
+
+    sf_arena *arena = &sf_arenas[1 + (block - base) / ARENA_HEAP_MAX];
+    if (block >= __atomic_load_n(&arena->end, __ATOMIC_ACQUIRE))
+        return NULL;
+    return arena;
+}
+
+/**
+ * @brief Start of an arena's heap.
+ * 
+ * @param arena 
+ * @return void* 
+ */
+void *arena_start(sf_arena *arena)
+{
+    return (arena == &main_arena) ? sf_mem_start() : arena->start;
+}
+
+/**
+ * @brief End of an arena's heap.
+ * 
+ * @param arena 
+ * @return void* 
+ */
+void *arena_end(sf_arena *arena)
+{
+    return (arena == &main_arena) ? sf_mem_end() : arena->end;
+}
+
+/**
+ * @brief Start of the memory at the end of an arena's heap that reads
+ * as zeros until it is handed out: up to where the heap has reached
+ * since those pages were last committed. Never below arena_end().
+ * 
+ * @param arena 
+ * @return void* 
+ */
+void *arena_fresh(sf_arena *arena)
+{
+    return (arena == &main_arena) ? sf_mem_fresh() : arena->dirty_end;
+}
+
+/**
+ * @brief Adds the given number of pages to the end of an arena's heap,
+ * like repeated calls to sf_mem_grow() do for the main arena. An arena
+ * that runs out of room keeps the pages it could add.
+ * 
+ * @param arena 
+ * @param pages number of pages to add
+ * @return void* start of the new memory, NULL with sf_errno set to
+ * ENOMEM if the arena could not grow by all the pages
+ */
+void *arena_grow(sf_arena *arena, size_t pages)
+{
+    void *start = arena_end(arena);
+    if (arena == &main_arena)
+    {
+        for (size_t i = 0; i < pages; i++)
+            if (sf_mem_grow() == NULL)
+                return NULL;
+        return start;
+    }
+
+    void *limit = arena->start + ARENA_HEAP_MAX;
+    size_t size = pages * PAGE_SZ;
+    if (pages > (size_t)(limit - start) / PAGE_SZ)
+        size = (limit - start) / PAGE_SZ * PAGE_SZ;
+    // Commit whole granules of the backend once the heap runs past what is committed
+    if (start + size > arena->committed)
+    {
+        size_t granularity = arenas_backend->granularity;
+        size_t commit = ((size_t)(start + size - arena->committed) + granularity - 1) / granularity * granularity;
+        if (arenas_backend->commit(arena->committed, commit) == -1)
+            size = 0;
+        else
+            arena->committed += commit;
+    }
+    if (start + size > arena->dirty_end)
+        arena->dirty_end = start + size;
+    __atomic_store_n(&arena->end, start + size, __ATOMIC_RELEASE);
+
+    if (size / PAGE_SZ < pages)
+    {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    return start;
+}
+
+/**
+ * @brief Gives the given number of bytes at the end of an arena's heap
+ * back to the OS. The main arena gives them back to its backend
+ * with sf_mem_shrink(). The first page is always kept.
+ * 
+ * @param arena
+ * @param size number of bytes, a multiple of PAGE_SZ
+ * @return int  0 if successful
+ *              -1 if the arena cannot shrink by that much
+ */
+int arena_shrink(sf_arena *arena, size_t size)
+{
+    if (arena_end(arena) - size < arena_start(arena) + PAGE_SZ)
+        return -1;
+    if (arena == &main_arena)
+        return sf_mem_shrink(size);
+
+    void *end = arena->end - size;
+
+    // Only granules the heap no longer reaches into can be decommitted
+    size_t granularity = arenas_backend->granularity;
+    void *committed = arena->start + ((size_t)(end - arena->start) + granularity - 1) / granularity * granularity;
+    if (committed < arena->committed)
+    {
+        if (arenas_backend->decommit(committed, arena->committed - committed) == -1)
+            return -1;
+        if (arena->dirty_end > committed)
+            arena->dirty_end = committed;
+        arena->committed = committed;
+    }
+    __atomic_store_n(&arena->end, end, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void arena_lock(sf_arena *arena)
+{
+    pthread_mutex_lock(&arena->lock);
+}
+
+void arena_unlock(sf_arena *arena)
+{
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/**
+ * @brief Locks every arena that is set up, so that a child created by
+ * fork() does not inherit a lock held by another thread.
+ */
+void arena_lock_all()
+{
+    pthread_mutex_lock(&arenas_lock);
+    for (int i = 0; i < NUM_ARENAS_MAX; i++)
+        if (sf_arenas[i].free_list_heads != NULL)
+            arena_lock(&sf_arenas[i]);
+}
+
+/**
+ * @brief Unlocks what arena_lock_all() locked.
+ */
+void arena_unlock_all()
+{
+    for (int i = NUM_ARENAS_MAX - 1; i >= 0; i--)
+        if (sf_arenas[i].free_list_heads != NULL)
+            arena_unlock(&sf_arenas[i]);
+    pthread_mutex_unlock(&arenas_lock);
+}
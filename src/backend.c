@@ -0,0 +1,120 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "sfmm.h"
+#include "mem.h"
+#include "backend.h"
+
+static void *mmap_reserve(size_t size)
+{
+    void *base = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return (base == MAP_FAILED) ? NULL : base;
+}
+
+static int mmap_commit(void *addr, size_t size)
+{
+    return mprotect(addr, size, PROT_READ | PROT_WRITE);
+}
+
+static int mmap_decommit(void *addr, size_t size)
+{
+    if (madvise(addr, size, MADV_DONTNEED) == -1)
+        return -1;
+    return mprotect(addr, size, PROT_NONE);
+}
+
+const sf_backend sf_mmap_backend = {
+    .name = "mmap",
+    .granularity = PAGE_SZ,
+    .reserve = mmap_reserve,
+    .commit = mmap_commit,
+    .decommit = mmap_decommit,
+    .zeroed = 1,
+};
+
+/**
+ * @brief Allocates the whole heap at once. The block is never freed,
+ * since the heap lives as long as the program.
+ *
+ * @param size size of the heap
+ * @return void* start of the heap, 64-byte aligned
+ */
+static void *malloc_reserve(size_t size)
+{
+    void *base = malloc(size + ALIGNMENT_SIZE);
+    if (base == NULL)
+        return NULL;
+    return (void *)(((uintptr_t)base + ALIGNMENT_SIZE - 1) & ~(uintptr_t)(ALIGNMENT_SIZE - 1));
+}
+
+static int malloc_commit(void *addr, size_t size)
+{
+    return 0;
+}
+
+const sf_backend sf_malloc_backend = {
+    .name = "malloc",
+    .granularity = PAGE_SZ,
+    .reserve = malloc_reserve,
+    .commit = malloc_commit,
+    .decommit = malloc_commit,
+};
+
+/**
+ * @brief Reserves a range starting on a huge page boundary, so that
+ * every huge page of the heap can be backed by one TLB entry. Marking
+ * it for transparent huge pages is only advice: without them the heap
+ * simply uses regular pages.
+ *
+ * @param size size of the heap, a multiple of HUGE_PAGE_SZ
+ * @return void* start of the heap
+ */
+static void *thp_reserve(size_t size)
+{
+    void *base = mmap_reserve(size + HUGE_PAGE_SZ);
+    if (base == NULL)
+        return NULL;
+
+    void *start = (void *)(((uintptr_t)base + HUGE_PAGE_SZ - 1) & ~(uintptr_t)(HUGE_PAGE_SZ - 1));
+    if (start > base)
+        munmap(base, start - base);
+    munmap(start + size, base + HUGE_PAGE_SZ - start);
+    madvise(start, size, MADV_HUGEPAGE);
+    return start;
+}
+
+const sf_backend sf_thp_backend = {
+    .name = "thp",
+    .granularity = HUGE_PAGE_SZ,
+    .reserve = thp_reserve,
+    .commit = mmap_commit,
+    .decommit = mmap_decommit,
+    .zeroed = 1,
+};
+
+/**
+ * @brief Reserves the heap in huge pages from the hugetlbfs pool. The
+ * kernel sets aside pool pages for the whole range right away, so this
+ * fails up front, rather than with SIGBUS on first touch, when the pool
+ * cannot hold the maximum heap size.
+ *
+ * @param size size of the heap, a multiple of HUGE_PAGE_SZ
+ * @return void* start of the heap
+ */
+static void *hugetlb_reserve(size_t size)
+{
+    void *base = mmap(NULL, size, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    return (base == MAP_FAILED) ? NULL : base;
+}
+
+const sf_backend sf_hugetlb_backend = {
+    .name = "hugetlb",
+    .granularity = HUGE_PAGE_SZ,
+    .fallback = &sf_thp_backend,
+    .reserve = hugetlb_reserve,
+    .commit = mmap_commit,
+    .decommit = mmap_decommit,
+    .zeroed = 1,
+};
@@ -1,100 +1,171 @@
+#define _GNU_SOURCE
+#include <sys/mman.h>
 #include "mem.h"
 #include "heap.h"
 #include "sfmm.h"
+#include "arena.h"
+#include "tree.h"
+#include "stats.h"
+#include "remote.h"
 #include "debug.h"
 
+/*
+ * Size classes of the schedule chosen at build time (see classes.h): the upper bound of
+ * each class but the last in units of ALIGNMENT_SIZE, and the class of each size of up
+ * to CLASS_LOOKUP_UNITS units.
+ */
+static const size_t class_bounds[NUM_FREE_LISTS - 1] = CLASS_BOUNDS;
+static const unsigned char size_classes[CLASS_LOOKUP_UNITS + 1] = CLASS_LOOKUP;
+
+/*
+ * Pages inside a free block that release_block() gave back to the OS, kept right after
+ * its tree links. Putting the block on a free list forgets them, since whatever made it
+ * free may have written to them; start is NULL when there are none.
+ */
+typedef struct released_pages {
+    void *start;
+    void *end;
+} released_pages;
+
+#define RELEASED(block) ((released_pages *)((void *)&(block)->body.links + FREE_LINKS_SIZE))
+
 /**
- * @brief Initializes the heap. Initializes the
+ * @brief Gets the index of the free list that holds blocks of
+ * the given size. Small sizes are looked up, larger ones binary
+ * searched in the class bounds.
+ * 
+ * @param block_size size of the block
+ * @return int index of the size class
+ */
+int size_class(size_t block_size)
+{
+    size_t units = block_size / ALIGNMENT_SIZE;
+    if (units <= CLASS_LOOKUP_UNITS)
+        return size_classes[units];
+
+    int low = size_classes[CLASS_LOOKUP_UNITS];
+    int high = NUM_FREE_LISTS - 1;
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
+        if (class_bounds[mid] < units)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/**
+ * @brief Finds the first non-empty free list of an arena at or
+ * after the given index using its bitmap of non-empty lists.
+ * 
+ * @param arena
+ * @param index first size class to look at
+ * @return int index of the free list, -1 if all of them are empty
+ */
+static int next_nonempty_class(sf_arena *arena, int index)
+{
+    int word = index / 64;
+    if (word >= FREE_LIST_WORDS)
+        return -1;
+
+    uint64_t bits = arena->nonempty[word] & (~(uint64_t)0 << (index % 64));
+    while (bits == 0)
+    {
+        if (++word == FREE_LIST_WORDS)
+            return -1;
+        bits = arena->nonempty[word];
+    }
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+/**
+ * @brief Initializes the heap of an arena. Initializes the
  * freelists, prologue, epilogue and free block.
  * 
+ * @param arena
  * @return int  0 if successful 
  *             -1 if unsuccessful
  */
-int init_heap()
+int init_heap(sf_arena *arena)
 {
-    int *status = sf_mem_grow();
+    int *status = arena_grow(arena, 1);
 
     /* Check if sf_mem_grow was successful */
     if (status == NULL)
         return -1;
 
-    init_freelists();
-    init_prologue();
-    init_epilogue();
-    sf_block *remaining_block = get_remaining();
+    init_freelists(arena);
+    init_prologue(arena);
+    init_epilogue(arena);
+    sf_block *remaining_block = get_remaining(arena);
     add_to_freelist(remaining_block);
 
     return 0;
 }
 
 /**
- * @brief Grows the heap by a page amount
+ * @brief Grows the heap of an arena by as many pages as it takes for
+ * the last block to have the given size. The new pages replace the old
+ * epilogue and are coalesced with the last block if that is free.
  * 
- * @return int  0 if successful
- *              -1 if unsuccessful
+ * @param arena
+ * @param size size the last block needs to have
+ * @return sf_block* the last block, on the free lists, NULL if the heap
+ * could not grow enough. Whatever it did grow stays on the free lists.
  */
-int grow_heap()
+sf_block *grow_heap(sf_arena *arena, size_t size)
 {
     //Get the old epilogue
-    size_t *old_epilogue = sf_mem_end();
+    size_t *old_epilogue = arena_end(arena);
     old_epilogue--;
 
-    int *status = sf_mem_grow();
-    if (status == NULL)
-        return -1;
+    // A free last block already covers part of the request
+    size_t last_size = (*old_epilogue & PREV_BLOCK_ALLOCATED) ? 0 : (old_epilogue[-1] & SIZE_MASK);
+    size_t needed = (size > last_size) ? size - last_size : 0;
+    size_t pages = needed / PAGE_SZ + (needed % PAGE_SZ != 0);
+    if (pages == 0)
+        pages = 1;
+
+    int *status = arena_grow(arena, pages);
 
-    size_t *new_epilogue = sf_mem_end();
+    size_t *new_epilogue = arena_end(arena);
     new_epilogue--;
+    if (new_epilogue == old_epilogue)
+        return NULL;
+    // Growing by only part of the pages still counts
+    sf_count(heap_grows);
     *new_epilogue = 0 | THIS_BLOCK_ALLOCATED;
 
-    sf_block *left_over_block = NULL;
-    size_t block_size;
-
-    if (is_prev_allocd((sf_block *)(old_epilogue - 1)))
+    // Start from old epilogue end at new epilogue
+    size_t block_size = (void *)new_epilogue - (void *)old_epilogue;
+    sf_block *left_over_block = (void *)(old_epilogue - 1);
+    if (is_prev_allocd(left_over_block))
     {
-        old_epilogue--; // now at the footer of the block before the old epilogue
-        block_size = *old_epilogue & SIZE_MASK;
-
-        left_over_block = (void *)old_epilogue - block_size;
-        //Start from previous block end at the new epilogue
-        block_size = (void *)new_epilogue - (void *)left_over_block - 8;
-        left_over_block->header = block_size;
-        set_footer(left_over_block, block_size);
-        // When coalescing, we don't need to add the freed block into the
-        // free  lists because all we're doing is extending the block
-        // that's already there
+        block_size |= PREV_BLOCK_ALLOCATED;
     }
-    else
-    {
-        block_size = (void *)new_epilogue - (void *)old_epilogue;
-        // Start from old epilogue end at new epilogue
-        old_epilogue--;
-        if (is_prev_allocd((void *)old_epilogue))
-        {
-            block_size |= PREV_BLOCK_ALLOCATED;
-        }
-        left_over_block = (void *)old_epilogue;
-        left_over_block->header = block_size;
-        set_footer(left_over_block, block_size);
-        coalesce(left_over_block);
-    }
-    return 0;
+    left_over_block->header = block_size;
+    set_footer(left_over_block, block_size);
+    left_over_block = coalesce(left_over_block);
+    return (status == NULL) ? NULL : left_over_block;
 }
 
 /**
  * @brief Get the remaining object
  * 
+ * @param arena
  * @return sf_block* 
  */
-sf_block *get_remaining()
+sf_block *get_remaining(sf_arena *arena)
 {
     // Get end of prologue
-    size_t *heap_start = sf_mem_start();
+    size_t *heap_start = arena_start(arena);
     heap_start += 6;
     sf_block *remaining_block = (void *)heap_start + get_size((sf_block *)heap_start);
 
     // Get beginning of epilogue
-    size_t *heap_end = sf_mem_end();
+    size_t *heap_end = arena_end(arena);
     heap_end -= 2; // Skip from epilogue prev_footer to header
 
     // Set size to end of prologue - beginning of epilogue
@@ -110,10 +181,11 @@ sf_block *get_remaining()
  * @brief Initializes the prologue with a 64 byte size 
  * and the allocated bit.
  * 
+ * @param arena
  */
-void init_prologue()
+void init_prologue(sf_arena *arena)
 {
-    size_t *heap_start = sf_mem_start();
+    size_t *heap_start = arena_start(arena);
     heap_start += 6; // Size of size_t is 8 so adding 6 to it is the same as doing += 6*8
     size_t size = ALIGNMENT_SIZE | THIS_BLOCK_ALLOCATED;
     *(heap_start + 1) = size; // Set the allocated bit
@@ -124,10 +196,11 @@ void init_prologue()
  * going to the end of the heap and go
  * upwards by a memory row.
  * 
+ * @param arena
  */
-void init_epilogue()
+void init_epilogue(sf_arena *arena)
 {
-    size_t *heap_end = sf_mem_end();
+    size_t *heap_end = arena_end(arena);
     heap_end--;
     *heap_end = 0 | THIS_BLOCK_ALLOCATED;
 }
@@ -136,18 +209,25 @@ void init_epilogue()
  * @brief Initializes the freelists by making all the sentinel
  * nodes point to themselves.
  * 
+ * @param arena
  */
-void init_freelists()
+void init_freelists(sf_arena *arena)
 {
+    sf_block *free_list_heads = arena->free_list_heads;
     for (int i = 0; i < NUM_FREE_LISTS; i++)
     {
-        sf_free_list_heads[i].body.links.next = &sf_free_list_heads[i];
-        sf_free_list_heads[i].body.links.prev = &sf_free_list_heads[i];
+        free_list_heads[i].body.links.next = &free_list_heads[i];
+        free_list_heads[i].body.links.prev = &free_list_heads[i];
     }
+    for (int i = 0; i < FREE_LIST_WORDS; i++)
+        arena->nonempty[i] = 0;
+    for (int i = 0; i < NUM_TREE_CLASSES; i++)
+        arena->tree_roots[i] = NULL;
 }
 
 /**
  * @brief Adds a block to the appropriate free list size class
+ * of the arena that owns it.
  * 
  * @param block block to be inserted
  */
@@ -155,63 +235,209 @@ void add_to_freelist(sf_block *block)
 {
     if (!is_free(block))
         return;
-    size_t block_size = get_size(block);
-    int fib_arr[NUM_FREE_LISTS];
-    int *class_sizes = fib_vals(fib_arr, NUM_FREE_LISTS);
-    int i;
+    RELEASED(block)->start = NULL;
+    sf_arena *arena = arena_of(block);
+    sf_block *free_list_heads = arena->free_list_heads;
+    int i = size_class(get_size(block));
+    arena->nonempty[i / 64] |= (uint64_t)1 << (i % 64);
 
-    /* Traverse through the class_sizes and find the block that is greater or equal to the size of the block */
-    for (i = 0; i < NUM_FREE_LISTS-1; i++)
+    sf_block *first = free_list_heads[i].body.links.next;
+    first->body.links.prev = block;
+    block->body.links.next = first;
+    block->body.links.prev = &free_list_heads[i];
+    free_list_heads[i].body.links.next = block;
+
+    if (i >= TREE_MIN_CLASS)
+        arena->tree_roots[i - TREE_MIN_CLASS] = tree_insert(arena->tree_roots[i - TREE_MIN_CLASS], block);
+}
+
+/**
+ * @brief Looks through all the free lists of an arena once, without
+ * growing the heap, for a block whose size is greater than or equal
+ * to block_size. The block is removed from its free list.
+ * 
+ * @param arena
+ * @param block_size size of the block
+ * @return sf_block* instance of the free block, NULL if none fits
+ */
+sf_block *search_free_lists(sf_arena *arena, size_t block_size)
+{
+    sf_block *free_list_heads = arena->free_list_heads;
+    int i = size_class(block_size);
+    sf_block *start_of_class_size = NULL;
+
+    // The block's own class may hold smaller blocks, so it is searched
+    // best fit if it is indexed by a tree and first fit otherwise
+    if (i >= TREE_MIN_CLASS)
     {
-        if ((class_sizes[i] * ALIGNMENT_SIZE) >= block_size)
-            break;
+        start_of_class_size = tree_best_fit(arena->tree_roots[i - TREE_MIN_CLASS], block_size);
+    }
+    else
+    {
+        start_of_class_size = free_list_heads[i].body.links.next;
+        while (start_of_class_size != &free_list_heads[i] && get_size(start_of_class_size) < block_size)
+            start_of_class_size = start_of_class_size->body.links.next;
+        if (start_of_class_size == &free_list_heads[i])
+            start_of_class_size = NULL;
     }
 
-    sf_block *first = sf_free_list_heads[i].body.links.next;
-    first->body.links.prev = block;
-    block->body.links.next = first;
-    block->body.links.prev = &sf_free_list_heads[i];
-    sf_free_list_heads[i].body.links.next = block;
+    // Every block in a larger class is big enough
+    if (start_of_class_size == NULL)
+    {
+        i = next_nonempty_class(arena, i + 1);
+        if (i == -1)
+            return NULL;
+        if (i >= TREE_MIN_CLASS)
+            start_of_class_size = tree_best_fit(arena->tree_roots[i - TREE_MIN_CLASS], 0);
+        else
+            start_of_class_size = free_list_heads[i].body.links.next;
+    }
+    remove_from_freelist(start_of_class_size);
+    return start_of_class_size;
 }
 
 /**
- * @brief Looks through all the free lists to find a block
+ * @brief Looks through all the free lists of an arena to find a block
  * whose size is greater than or equal to the block_size
  * 
+ * @param arena
  * @param block_size size of the block
  * @return sf_block* instance of the free block
  */
-sf_block *find_block(size_t block_size)
+sf_block *find_block(sf_arena *arena, size_t block_size)
 {
-    while (true) {
-        for (int i = 0; i < NUM_FREE_LISTS; i++)
-        {
-            sf_block *start_of_class_size = sf_free_list_heads[i].body.links.next;
-
-            while (start_of_class_size != &sf_free_list_heads[i])
-            {
-                if (get_size(start_of_class_size) >= block_size)
-                {
-                    remove_from_freelist(start_of_class_size);
-                    return start_of_class_size;
-                }
-                start_of_class_size = start_of_class_size->body.links.next;
-            }
-        }
-        // Once the program has made it here, it means we could not find a block with an adequate size
-        // so we will need to extend the heap and call the function again.
-        if (grow_heap() == -1) {
-            return NULL;
-        }
+    sf_block *block = search_free_lists(arena, block_size);
+    if (block != NULL)
+        return block;
+    // Blocks freed by other threads or whose coalescing was deferred may merge into one that fits
+    if (remote_drain(arena) + quick_consolidate(arena) > 0 && (block = search_free_lists(arena, block_size)) != NULL)
+        return block;
+    // Once the program has made it here, it means we could not find a block with an adequate size
+    // so we extend the heap by enough pages at once. The last block is then big enough.
+    block = grow_heap(arena, block_size);
+    if (block != NULL)
+        remove_from_freelist(block);
+    return block;
+}
+
+/**
+ * @brief Marks a block taken off the free lists as allocated and
+ * splits off whatever is not needed for a block of the given size.
+ * The next block's prev_alloc bit is set when nothing is split off.
+ * 
+ * @param block block returned by find_block()
+ * @param size aligned size of the allocation
+ */
+void place(sf_block *block, size_t size)
+{
+    size_t allocated_size = block->header | THIS_BLOCK_ALLOCATED;
+    block->header = allocated_size;
+    set_footer(block, allocated_size);
+
+    sf_block *next = get_next_block(block);
+    next->header |= PREV_BLOCK_ALLOCATED;
+
+    split(block, size);
+}
+
+/**
+ * @brief Finds a free block in an arena and allocates the part of it
+ * whose payload starts at a multiple of align. The leading fragment
+ * is freed and the trailing one is split off, so both coalesce with
+ * their free neighbours.
+ * 
+ * @param arena
+ * @param size aligned size of the allocation
+ * @param align alignment of the payload, a power of two
+ * @return sf_block* allocated block, NULL if the heap is exhausted
+ */
+sf_block *find_aligned_block(sf_arena *arena, size_t size, size_t align)
+{
+    if (align <= ALIGNMENT_SIZE)
+    {
+        sf_block *block = find_block(arena, size);
+        if (block != NULL)
+            place(block, size);
+        return block;
+    }
+
+    // Room for the worst case leading fragment, which is at least one minimum block
+    sf_block *block = find_block(arena, size + align + ALIGNMENT_SIZE);
+    if (block == NULL)
+        return NULL;
+
+    uintptr_t payload = (uintptr_t)&block->body.payload;
+    uintptr_t aligned = (payload + align - 1) & ~(uintptr_t)(align - 1);
+    if (aligned != payload && aligned - payload < ALIGNMENT_SIZE)
+        aligned += align;
+
+    size_t lead_size = aligned - payload;
+    if (lead_size == 0)
+    {
+        place(block, size);
+        return block;
+    }
+
+    size_t total_size = get_size(block);
+    sf_block *lead = block;
+    size_t lead_header = lead_size | (lead->header & PREV_BLOCK_ALLOCATED);
+    lead->header = lead_header;
+    set_footer(lead, lead_header);
+
+    block = (void *)lead + lead_size;
+    block->header = total_size - lead_size;
+    set_footer(block, block->header);
+    place(block, size);
+
+    // Only once the aligned block is allocated, so it is not absorbed
+    coalesce(lead);
+    return block;
+}
+
+/**
+ * @brief Grows an allocated block in place by absorbing the free block
+ * that follows it, growing the heap first if the block is the last one
+ * before the epilogue. Whatever is not needed is split off again.
+ * 
+ * @param arena arena owning the block, locked
+ * @param block allocated block
+ * @param size aligned size the block needs to have
+ * @return int  0 if the block now has at least the given size
+ *              -1 if it cannot grow in place
+ */
+int grow_in_place(sf_arena *arena, sf_block *block, size_t size)
+{
+    size_t block_size = get_size(block);
+    sf_block *next = get_next_block(block);
+
+    size_t next_size = is_free(next) ? get_size(next) : 0;
+    if (block_size + next_size < size)
+    {
+        // Only the last block can take more memory from the heap
+        sf_block *after = (next_size == 0) ? next : get_next_block(next);
+        if (get_size(after) != 0 || grow_heap(arena, size - block_size) == NULL)
+            return -1;
+        // The heap may have grown by less than asked before running out of room
+        next = get_next_block(block);
+        if (block_size + get_size(next) < size)
+            return -1;
     }
-    return NULL;
+
+    remove_from_freelist(next);
+    size_t header = (block_size + get_size(next)) | (block->header & (THIS_BLOCK_ALLOCATED | PREV_BLOCK_ALLOCATED));
+    block->header = header;
+    set_footer(block, header);
+    get_next_block(block)->header |= PREV_BLOCK_ALLOCATED;
+
+    split(block, size);
+    return 0;
 }
 
 /**
  * @brief (bear with me here) Sets the current block's previous's next field
  * to current blocks' next field.
  * And sets current block's next's previous field to current block's previous
- * field.
+ * field. Blocks in tree-indexed classes are taken out of the tree too.
  * 
  * @param block 
  */
@@ -219,6 +445,125 @@ void remove_from_freelist(sf_block *block)
 {
     (block->body.links.prev)->body.links.next = block->body.links.next;
     (block->body.links.next)->body.links.prev = block->body.links.prev;
+
+    int i = size_class(get_size(block));
+    sf_arena *arena = NULL;
+    if (i >= TREE_MIN_CLASS)
+    {
+        arena = arena_of(block);
+        arena->tree_roots[i - TREE_MIN_CLASS] = tree_remove(arena->tree_roots[i - TREE_MIN_CLASS], block);
+    }
+
+    // Only the list header is left, clear the list's bit
+    if (block->body.links.prev == block->body.links.next)
+    {
+        arena = (arena == NULL) ? arena_of(block) : arena;
+        arena->nonempty[i / 64] &= ~((uint64_t)1 << (i % 64));
+    }
+}
+
+/**
+ * @brief Gives the whole pages inside a free block back to the OS.
+ * The header, links and footer of the block are left alone; the
+ * rest of its contents reads as zero afterwards, and the block
+ * remembers so until it is put on a free list again.
+ * 
+ * @param block free block
+ * @return size_t number of bytes released
+ */
+size_t release_block(sf_block *block)
+{
+    uintptr_t lo = (uintptr_t)block + ALIGNMENT_SIZE;
+    uintptr_t hi = (uintptr_t)block + get_size(block);
+    lo = (lo + PAGE_SZ - 1) & ~(PAGE_SZ - 1);
+    hi &= ~(PAGE_SZ - 1);
+    if (hi <= lo || madvise((void *)lo, hi - lo, MADV_DONTNEED) == -1)
+        return 0;
+    RELEASED(block)->start = (void *)lo;
+    RELEASED(block)->end = (void *)hi;
+    return hi - lo;
+}
+
+/**
+ * @brief Pages inside a free block that were released with
+ * release_block() and have not been written since, so they read as zeros.
+ * 
+ * @param block block found on the free lists, not placed yet
+ * @param end set to the end of the pages
+ * @return void* start of the pages, NULL if there are none
+ */
+void *released_pages_of(sf_block *block, void **end)
+{
+    *end = RELEASED(block)->end;
+    return RELEASED(block)->start;
+}
+
+/**
+ * @brief Releases the pages inside every free block of an arena that
+ * spans at least two pages.
+ * 
+ * @param arena arena, locked
+ * @return size_t number of bytes released
+ */
+size_t release_free_blocks(sf_arena *arena)
+{
+    sf_block *free_list_heads = arena->free_list_heads;
+    size_t released = 0;
+    for (int i = size_class(2 * PAGE_SZ); i < NUM_FREE_LISTS; i++)
+    {
+        for (sf_block *block = free_list_heads[i].body.links.next; block != &free_list_heads[i]; block = block->body.links.next)
+        {
+            if (get_size(block) >= 2 * PAGE_SZ)
+                released += release_block(block);
+        }
+    }
+    return released;
+}
+
+/**
+ * @brief Shrinks an arena's heap when its last block is free, keeping
+ * pad bytes of that block. If the arena's memory cannot be shrunk, the
+ * block's pages are released with release_block() instead.
+ * 
+ * @param arena arena, locked
+ * @param pad number of free bytes to keep at the end of the heap
+ * @return size_t number of bytes given back to the OS
+ */
+size_t trim_heap(sf_arena *arena, size_t pad)
+{
+    size_t *epilogue = arena_end(arena) - HEADER_SIZE;
+    if (*epilogue & PREV_BLOCK_ALLOCATED)
+        return 0;
+
+    sf_block *last = get_prev_block((sf_block *)(epilogue - 1));
+    size_t size = get_size(last);
+    if (size < pad + PAGE_SZ)
+        return 0;
+    size_t trim = (size - pad) / PAGE_SZ * PAGE_SZ;
+
+    remove_from_freelist(last);
+    if (arena_shrink(arena, trim) == -1)
+    {
+        add_to_freelist(last);
+        return release_block(last);
+    }
+
+    size_t prev_allocd = last->header & PREV_BLOCK_ALLOCATED;
+    epilogue = arena_end(arena) - HEADER_SIZE;
+    if (size == trim)
+    {
+        // The block is gone, its predecessor is followed by the epilogue
+        *epilogue = THIS_BLOCK_ALLOCATED | prev_allocd;
+    }
+    else
+    {
+        *epilogue = THIS_BLOCK_ALLOCATED;
+        last->header = (size - trim) | prev_allocd;
+        set_footer(last, last->header);
+        add_to_freelist(last);
+    }
+    debug("trimmed %zu bytes from arena %d", trim, arena->index);
+    return trim;
 }
 
 /**
@@ -226,13 +571,17 @@ void remove_from_freelist(sf_block *block)
  * precedes or follows it in the heap.
  * 
  * @param block
+ * @return sf_block* the block after coalescing
  */
-void coalesce(sf_block *block)
+sf_block *coalesce(sf_block *block)
 {
     size_t prev_size, cur_size, next_size, header_size;
+    // The pages a free predecessor released stay untouched when it grows
+    released_pages released = { NULL, NULL };
     if (!is_prev_allocd(block))
     {
         sf_block *prev = get_prev_block(block);
+        released = *RELEASED(prev);
         remove_from_freelist(prev);
         prev_size = get_size(prev);
         cur_size = get_size(block);
@@ -255,6 +604,8 @@ void coalesce(sf_block *block)
         set_footer(next, next_size + cur_size);
     }
     add_to_freelist(block);
+    *RELEASED(block) = released;
+    return block;
 }
 
 /**
@@ -271,7 +622,7 @@ void split(sf_block *block, size_t size)
     size = (size < ALIGNMENT_SIZE) ? ALIGNMENT_SIZE : size;
     size_t total_block_size = get_size(block);
 
-    if (total_block_size - size >= ALIGNMENT_SIZE)
+    if (total_block_size >= size + ALIGNMENT_SIZE)
     {
 
         size_t new_size = total_block_size - size;
@@ -284,8 +635,9 @@ void split(sf_block *block, size_t size)
         // 1s (the current block is allocated and the previous is)
         // if not, set the last bit 1 (the current block is allocated)
         size |= (is_prev_allocd(block)) ? (THIS_BLOCK_ALLOCATED + PREV_BLOCK_ALLOCATED) : THIS_BLOCK_ALLOCATED;
+        // No footer for the allocated part: that word belongs to its payload,
+        // which realloc() may already have filled
         block->header = size;
-        set_footer(block, block->header);
         sf_block *remainder = (void*)block + get_size(block);
         remainder->header = new_size;
         set_footer(remainder, remainder->header);
@@ -294,16 +646,4 @@ void split(sf_block *block, size_t size)
         
         coalesce(remainder);
     }
-}
-
-int* fib_vals(int *a, int fib_count) {
-    int i;
-
-    a[0] = 1; a[1] = 2;
-
-    for (i = 2; i  <= fib_count; i++) {
-        a[i] = a[i-1] + a[i-2];
-    }
-
-    return a;
 }
\ No newline at end of file
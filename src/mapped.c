@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "sfmm.h"
+#include "mem.h"
+#include "arena.h"
+#include "mapped.h"
+#include "stats.h"
+#include "debug.h"
+
+/*
+ * Payloads of the live mappings, in an open-addressed hash set that is itself mapped and
+ * doubles when it is half full. A pointer is only taken for a mapped allocation if it is
+ * in the set, so sf_free never reads the memory in front of a pointer it did not hand out.
+ */
+#define MAPPINGS_MIN 1024
+#define MAPPING_REMOVED ((void *)1)
+
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+static void **mappings;
+static size_t mappings_capacity;
+static size_t mappings_used;    /* Live payloads and removed slots. */
+
+static size_t mapping_slot(void *pp)
+{
+    return ((uintptr_t)pp >> 12) * 0x9e3779b97f4a7c15ULL >> 20;
+}
+
+/**
+ * @brief Finds the slot of a payload in the set of mappings.
+ * 
+ * @param pp payload
+ * @return void** slot holding pp, NULL if it is not in the set
+ */
+static void **mapping_find(void *pp)
+{
+    if (mappings == NULL)
+        return NULL;
+    for (size_t i = mapping_slot(pp); ; i++)
+    {
+        void **slot = &mappings[i & (mappings_capacity - 1)];
+        if (*slot == pp)
+            return slot;
+        if (*slot == NULL)
+            return NULL;
+    }
+}
+
+/**
+ * @brief Moves the live payloads into a new set of the given capacity.
+ * 
+ * @param capacity power of two
+ * @return int 0 if successful, -1 if it could not be mapped
+ */
+static int mappings_resize(size_t capacity)
+{
+    void **table = mmap(NULL, capacity * sizeof(void *), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED)
+        return -1;
+
+    size_t used = 0;
+    for (size_t i = 0; i < mappings_capacity; i++)
+    {
+        void *pp = mappings[i];
+        if (pp == NULL || pp == MAPPING_REMOVED)
+            continue;
+        size_t j = mapping_slot(pp);
+        while (table[j & (capacity - 1)] != NULL)
+            j++;
+        table[j & (capacity - 1)] = pp;
+        used++;
+    }
+    if (mappings != NULL)
+        munmap(mappings, mappings_capacity * sizeof(void *));
+    mappings = table;
+    mappings_capacity = capacity;
+    mappings_used = used;
+    return 0;
+}
+
+/**
+ * @brief Makes sure the set of mappings has room for one more payload.
+ * 
+ * @return int 0 if successful, -1 if the set could not grow
+ */
+static int mapping_reserve()
+{
+    if (2 * (mappings_used + 1) <= mappings_capacity)
+        return 0;
+    return mappings_resize(mappings_capacity < MAPPINGS_MIN ? MAPPINGS_MIN : 2 * mappings_capacity);
+}
+
+/**
+ * @brief Adds a payload to the set of mappings.
+ * 
+ * @param pp payload, not in the set
+ * @return int 0 if successful, -1 if the set could not grow
+ */
+static int mapping_add(void *pp)
+{
+    if (mapping_reserve() == -1)
+        return -1;
+
+    size_t i = mapping_slot(pp);
+    while (mappings[i & (mappings_capacity - 1)] != NULL && mappings[i & (mappings_capacity - 1)] != MAPPING_REMOVED)
+        i++;
+    if (mappings[i & (mappings_capacity - 1)] == NULL)
+        mappings_used++;
+    mappings[i & (mappings_capacity - 1)] = pp;
+    return 0;
+}
+
+static void mapping_remove(void *pp)
+{
+    void **slot = mapping_find(pp);
+    if (slot != NULL)
+        *slot = MAPPING_REMOVED;
+}
+
+/**
+ * @brief Locks the set of mappings, so that a child created by fork()
+ * does not inherit it locked by another thread.
+ */
+void mapped_lock()
+{
+    pthread_mutex_lock(&mappings_lock);
+}
+
+void mapped_unlock()
+{
+    pthread_mutex_unlock(&mappings_lock);
+}
+
+static sf_header *mapped_header(void *pp)
+{
+    return (sf_header *)(pp - HEADER_SIZE);
+}
+
+/**
+ * @brief Length of a mapping holding a payload of the given size.
+ * 
+ * @param size requested size
+ * @return size_t length of the mapping, 0 if too large
+ */
+static size_t mapping_length(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    if (size > SIZE_MAX - ALIGNMENT_SIZE - page)
+        return 0;
+    return (size + ALIGNMENT_SIZE + page - 1) & ~(page - 1);
+}
+
+/**
+ * @brief Maps a region of its own for a large allocation.
+ * 
+ * @param size requested size
+ * @return void* payload, NULL with sf_errno set to ENOMEM if mmap fails
+ */
+void *mapped_alloc(size_t size)
+{
+    size_t length = mapping_length(size);
+    void *base = (length == 0) ? MAP_FAILED :
+        mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+
+    void *pp = base + ALIGNMENT_SIZE;
+    pthread_mutex_lock(&mappings_lock);
+    int status = mapping_add(pp);
+    pthread_mutex_unlock(&mappings_lock);
+    if (status == -1)
+    {
+        munmap(base, length);
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+
+    *mapped_header(pp) = length | MAPPED_BLOCK | THIS_BLOCK_ALLOCATED;
+    sf_count_add(mapped_bytes, length);
+    debug("mapped %zu bytes at %p", length, base);
+    return pp;
+}
+
+/**
+ * @brief Checks whether a pointer given to sf_free or sf_realloc
+ * is the payload of a live mapped allocation. Pointers into an arena
+ * are ruled out without taking the lock; the others are looked up in
+ * the set of mappings. Nothing is read through pp.
+ * 
+ * @param pp payload
+ * @return int 1 if it is, 0 otherwise
+ */
+int is_mapped(void *pp)
+{
+    if (pp == NULL || (uintptr_t)pp % ALIGNMENT_SIZE != 0 || arena_of(pp - 2 * HEADER_SIZE) != NULL)
+        return 0;
+
+    pthread_mutex_lock(&mappings_lock);
+    int found = (mapping_find(pp) != NULL);
+    pthread_mutex_unlock(&mappings_lock);
+    return found;
+}
+
+/**
+ * @brief Usable size of a mapped allocation.
+ * 
+ * @param pp payload
+ * @return size_t 
+ */
+size_t mapped_size(void *pp)
+{
+    return (*mapped_header(pp) & SIZE_MASK & ~(size_t)MAPPED_BLOCK) - ALIGNMENT_SIZE;
+}
+
+/**
+ * @brief Unmaps a mapped allocation. Aborts if munmap fails.
+ * 
+ * @param pp payload
+ */
+void mapped_free(void *pp)
+{
+    size_t length = mapped_size(pp) + ALIGNMENT_SIZE;
+    pthread_mutex_lock(&mappings_lock);
+    mapping_remove(pp);
+    pthread_mutex_unlock(&mappings_lock);
+    if (munmap(pp - ALIGNMENT_SIZE, length) == -1)
+        abort();
+    sf_count_sub(mapped_bytes, length);
+}
+
+/**
+ * @brief Resizes a mapped allocation with mremap, which moves the
+ * pages instead of copying them when the mapping cannot grow in place.
+ * 
+ * @param pp payload
+ * @param size new requested size
+ * @return void* new payload, NULL with sf_errno set to ENOMEM if mremap fails
+ */
+void *mapped_realloc(void *pp, size_t size)
+{
+    size_t old_length = mapped_size(pp) + ALIGNMENT_SIZE;
+    size_t length = mapping_length(size);
+    if (length == old_length)
+        return pp;
+
+    // Room is made in the set first, so that the moved payload cannot fail to be added
+    pthread_mutex_lock(&mappings_lock);
+    void *base = (length == 0 || mapping_reserve() == -1) ? MAP_FAILED :
+        mremap(pp - ALIGNMENT_SIZE, old_length, length, MREMAP_MAYMOVE);
+    if (base == MAP_FAILED)
+    {
+        pthread_mutex_unlock(&mappings_lock);
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    mapping_remove(pp);
+    pp = base + ALIGNMENT_SIZE;
+    mapping_add(pp);
+    pthread_mutex_unlock(&mappings_lock);
+    *mapped_header(pp) = length | MAPPED_BLOCK | THIS_BLOCK_ALLOCATED;
+    sf_count_add(mapped_bytes, length - old_length);
+    return pp;
+}
@@ -1,5 +1,6 @@
 #include "sfmm.h"
 #include "mem.h"
+#include "arena.h"
 #include "debug.h"
 
 /**
@@ -8,7 +9,7 @@
  * @param block 
  * @return int 
  */
-int get_size(sf_block *block)
+size_t get_size(sf_block *block)
 {
     sf_header *header = get_header(block);
     return *(header) & SIZE_MASK;
@@ -105,8 +106,43 @@ void free_block(sf_block *block) {
     }
 }
 
-int validate_block(void *pointer)
+/**
+ * @brief Rounds a requested payload size up to a block size: header
+ * included, a multiple of ALIGNMENT_SIZE and no smaller than it.
+ * 
+ * @param size requested payload size
+ * @return size_t block size, 0 if the request is too large
+ */
+size_t align_size(size_t size)
+{
+    if (size > SIZE_MAX - (HEADER_SIZE + ALIGNMENT_SIZE))
+        return 0;
+
+    size += HEADER_SIZE; // Account for header
+
+    // Make sure it is 64 bit aligned
+    if (size % ALIGNMENT_SIZE != 0)
+        size += ALIGNMENT_SIZE - (size % ALIGNMENT_SIZE);
+
+    // If requested size is less than 64, set it to 64
+    return (size < ALIGNMENT_SIZE) ? ALIGNMENT_SIZE : size;
+}
+
+/**
+ * @brief Checks the parts of a block that only its owner changes:
+ * payload alignment, bounds of the heap it is in, the size and the
+ * allocated bit. Cheap enough to run before a block is cached.
+ * 
+ * @param pointer start of the block
+ * @return int 1 if valid, 0 otherwise
+ */
+int validate_header(void *pointer)
 {
+    sf_arena *arena = arena_of(pointer);
+    if (arena == NULL)
+    {
+        return 0;
+    }
     pointer += (2 * HEADER_SIZE);
     if (pointer == NULL)
     {
@@ -116,11 +152,11 @@ int validate_block(void *pointer)
     {
         return 0;
     }
-    if (pointer < sf_mem_start() + (ALIGNMENT_SIZE - (2 * HEADER_SIZE)))
+    if (pointer < arena_start(arena) + (ALIGNMENT_SIZE - (2 * HEADER_SIZE)))
     {
         return 0;
     }
-    if (pointer > sf_mem_end() - HEADER_SIZE)
+    if (pointer > arena_end(arena) - HEADER_SIZE)
     {
         return 0;
     }
@@ -129,6 +165,30 @@ int validate_block(void *pointer)
     {
         return 0;
     }
+    // The next block's header has to be in the heap too, before the epilogue
+    size_t size = get_size(pointer);
+    if (size < ALIGNMENT_SIZE || size % ALIGNMENT_SIZE != 0 ||
+        size > (size_t)(arena_end(arena) - 2 * HEADER_SIZE - pointer))
+    {
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Checks a block and its link to the previous block.
+ * Must be called with the lock of the block's arena held, since the
+ * previous block may be changing otherwise.
+ * 
+ * @param pointer start of the block
+ * @return int 1 if valid, 0 otherwise
+ */
+int validate_block(void *pointer)
+{
+    if (!validate_header(pointer))
+    {
+        return 0;
+    }
     if (!is_prev_allocd(pointer) && !is_free(get_prev_block(pointer)))
     {
         return 0;
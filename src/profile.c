@@ -0,0 +1,340 @@
+#define _GNU_SOURCE
+#include <execinfo.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "sfmm.h"
+#include "profile.h"
+
+/* Hash buckets of the sample table, a power of two. */
+#define PROFILE_BUCKETS 16384
+
+typedef struct profile_entry {
+    void *pp;
+    size_t size;
+    struct profile_entry *next;     /* In its bucket, or in the list of unused entries. */
+    int depth;
+    void *stack[PROFILE_MAX_DEPTH];
+} profile_entry;
+
+__thread long profile_countdown;
+size_t profile_live;
+unsigned short profile_filter[PROFILE_FILTER_SIZE];
+
+static __thread int profile_started;
+static __thread int profile_busy;
+static __thread uint64_t profile_seed;
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static profile_entry *entries;
+static profile_entry *unused;
+static size_t entries_used;
+static profile_entry *buckets[PROFILE_BUCKETS];
+
+/**
+ * @brief Draws the number of bytes until the next sample from an
+ * exponential distribution whose mean is the sampling rate, so that
+ * every allocated byte is equally likely to be sampled.
+ *
+ * @return long
+ */
+static long next_interval()
+{
+    if (profile_seed == 0)
+        profile_seed = (uintptr_t)&profile_seed * 0x9e3779b97f4a7c15ULL | 1;
+    profile_seed ^= profile_seed << 13;
+    profile_seed ^= profile_seed >> 7;
+    profile_seed ^= profile_seed << 17;
+
+    // Uniform in (0, 1]
+    double u = ((profile_seed >> 11) + 1) / 9007199254740992.0;
+    double interval = -log(u) * sf_opts.profile_rate;
+    return (interval > LONG_MAX / 2) ? LONG_MAX / 2 : (long)interval + 1;
+}
+
+/**
+ * @brief Takes an entry of the sample table.
+ *
+ * @return profile_entry* NULL if the table is full
+ */
+static profile_entry *take_entry()
+{
+    if (unused != NULL)
+    {
+        profile_entry *entry = unused;
+        unused = entry->next;
+        return entry;
+    }
+    if (entries == NULL)
+    {
+        void *table = mmap(NULL, PROFILE_MAX_SAMPLES * sizeof(profile_entry), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (table == MAP_FAILED)
+            return NULL;
+        entries = table;
+    }
+    return (entries_used < PROFILE_MAX_SAMPLES) ? &entries[entries_used++] : NULL;
+}
+
+/**
+ * @brief Puts an entry in the bucket of its block.
+ *
+ * @param entry entry whose pp is set, with the table locked
+ */
+static void link_entry(profile_entry *entry)
+{
+    size_t hash = profile_hash(entry->pp);
+    entry->next = buckets[hash % PROFILE_BUCKETS];
+    buckets[hash % PROFILE_BUCKETS] = entry;
+    __atomic_fetch_add(&profile_filter[hash % PROFILE_FILTER_SIZE], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&profile_live, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Takes the entry of a block out of its bucket.
+ *
+ * @param pp payload, with the table locked
+ * @return profile_entry* NULL if the block has no sample
+ */
+static profile_entry *unlink_entry(void *pp)
+{
+    size_t hash = profile_hash(pp);
+    for (profile_entry **link = &buckets[hash % PROFILE_BUCKETS]; *link != NULL; link = &(*link)->next)
+    {
+        profile_entry *entry = *link;
+        if (entry->pp != pp)
+            continue;
+
+        *link = entry->next;
+        __atomic_fetch_sub(&profile_filter[hash % PROFILE_FILTER_SIZE], 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&profile_live, 1, __ATOMIC_RELAXED);
+        return entry;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Called once an allocation has used up the countdown of its
+ * thread: records the block with the backtrace of the allocation.
+ *
+ * @param pp payload
+ * @param size requested size
+ */
+void profile_sample(void *pp, size_t size)
+{
+    // backtrace() may allocate the first time it is called
+    if (profile_busy)
+        return;
+
+    // The first countdown of a thread starts at the first allocation it makes
+    if (!profile_started)
+    {
+        profile_started = 1;
+        profile_countdown += next_interval();
+        if (profile_countdown >= 0)
+            return;
+    }
+    while (profile_countdown < 0)
+        profile_countdown += next_interval();
+
+    void *stack[PROFILE_MAX_DEPTH + 1];
+    profile_busy = 1;
+    int depth = backtrace(stack, PROFILE_MAX_DEPTH + 1) - 1;
+    profile_busy = 0;
+
+    pthread_mutex_lock(&table_lock);
+    profile_entry *entry = take_entry();
+    if (entry != NULL)
+    {
+        // Leave out this function's own frame
+        entry->pp = pp;
+        entry->size = size;
+        entry->depth = (depth > 0) ? depth : 0;
+        for (int i = 0; i < entry->depth; i++)
+            entry->stack[i] = stack[i + 1];
+        link_entry(entry);
+    }
+    pthread_mutex_unlock(&table_lock);
+}
+
+/**
+ * @brief Drops the sample of a block, if it has one.
+ *
+ * @param pp payload of a block being freed
+ */
+void profile_forget(void *pp)
+{
+    pthread_mutex_lock(&table_lock);
+    profile_entry *entry = unlink_entry(pp);
+    if (entry != NULL)
+    {
+        entry->next = unused;
+        unused = entry;
+    }
+    pthread_mutex_unlock(&table_lock);
+}
+
+/**
+ * @brief Takes the sample of a block out of the table while the block
+ * is being resized, so that no other block given the same address in
+ * the meantime can be mistaken for it.
+ *
+ * @param pp payload
+ * @return struct profile_entry* NULL if the block has no sample
+ */
+struct profile_entry *profile_detach(void *pp)
+{
+    pthread_mutex_lock(&table_lock);
+    profile_entry *entry = unlink_entry(pp);
+    pthread_mutex_unlock(&table_lock);
+    return entry;
+}
+
+/**
+ * @brief Puts a sample taken out with profile_detach() back, for a
+ * block that kept its address and size.
+ *
+ * @param entry may be NULL
+ */
+void profile_reattach(struct profile_entry *entry)
+{
+    if (entry == NULL)
+        return;
+    pthread_mutex_lock(&table_lock);
+    link_entry(entry);
+    pthread_mutex_unlock(&table_lock);
+}
+
+/**
+ * @brief Gives up a sample taken out with profile_detach(), for a
+ * block that moved or changed size.
+ *
+ * @param entry may be NULL
+ */
+void profile_discard(struct profile_entry *entry)
+{
+    if (entry == NULL)
+        return;
+    pthread_mutex_lock(&table_lock);
+    entry->next = unused;
+    unused = entry;
+    pthread_mutex_unlock(&table_lock);
+}
+
+/**
+ * @brief Locks the sample table, so that a child created by fork()
+ * does not inherit it locked by another thread.
+ */
+void profile_lock()
+{
+    pthread_mutex_lock(&table_lock);
+}
+
+void profile_unlock()
+{
+    pthread_mutex_unlock(&table_lock);
+}
+
+/*
+ * Output buffer of sf_heap_profile_dump(). Writing goes through write() rather than
+ * stdio, which could allocate while the sample table is locked.
+ */
+typedef struct dump_buffer {
+    int fd;
+    int failed;
+    size_t length;
+    char text[4096];
+} dump_buffer;
+
+static void dump_flush(dump_buffer *out)
+{
+    size_t done = 0;
+    while (!out->failed && done < out->length)
+    {
+        ssize_t written = write(out->fd, out->text + done, out->length - done);
+        if (written <= 0)
+            out->failed = 1;
+        else
+            done += written;
+    }
+    out->length = 0;
+}
+
+static void dump_printf(dump_buffer *out, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void dump_printf(dump_buffer *out, const char *format, ...)
+{
+    va_list args;
+    if (sizeof(out->text) - out->length < 128)
+        dump_flush(out);
+    va_start(args, format);
+    int length = vsnprintf(out->text + out->length, sizeof(out->text) - out->length, format, args);
+    va_end(args);
+    if (length > 0)
+        out->length += length;
+}
+
+/**
+ * @brief Copies /proc/self/maps, which pprof needs to map the addresses
+ * of the backtraces to the binaries they belong to.
+ *
+ * @param out
+ */
+static void dump_maps(dump_buffer *out)
+{
+    int maps = open("/proc/self/maps", O_RDONLY);
+    if (maps == -1)
+        return;
+    dump_flush(out);
+    ssize_t length;
+    while ((length = read(maps, out->text, sizeof(out->text))) > 0)
+    {
+        out->length = length;
+        dump_flush(out);
+    }
+    close(maps);
+}
+
+int sf_heap_profile_dump(int fd)
+{
+    dump_buffer out = { .fd = fd };
+
+    profile_busy = 1;
+    pthread_mutex_lock(&table_lock);
+    size_t objects = 0, bytes = 0;
+    for (int i = 0; i < PROFILE_BUCKETS; i++)
+    {
+        for (profile_entry *entry = buckets[i]; entry != NULL; entry = entry->next)
+        {
+            objects++;
+            bytes += entry->size;
+        }
+    }
+
+    // gperftools heap profile format; pprof undoes the sampling from the rate
+    dump_printf(&out, "heap profile: %zu: %zu [0: 0] @ heap_v2/%zu\n", objects, bytes,
+                sf_opts.profile_rate);
+    for (int i = 0; i < PROFILE_BUCKETS; i++)
+    {
+        for (profile_entry *entry = buckets[i]; entry != NULL; entry = entry->next)
+        {
+            dump_printf(&out, "1: %zu [0: 0] @", entry->size);
+            for (int j = 0; j < entry->depth; j++)
+                dump_printf(&out, " %p", entry->stack[j]);
+            dump_printf(&out, "\n");
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+
+    dump_printf(&out, "\nMAPPED_LIBRARIES:\n");
+    dump_maps(&out);
+    dump_flush(&out);
+    profile_busy = 0;
+    return out.failed ? -1 : 0;
+}
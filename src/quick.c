@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include "sfmm.h"
+#include "mem.h"
+#include "heap.h"
+#include "arena.h"
+#include "quick.h"
+#include "debug.h"
+
+#define QUICK_INDEX(size) ((size) / ALIGNMENT_SIZE - 1)
+
+/* Marks listed blocks (in body.links.prev) so double frees can be caught. */
+#define QUICK_KEY(arena) ((sf_block *)(arena)->quick_lists)
+
+/**
+ * @brief Pops a block of exactly the given size from the quick lists
+ * of an arena.
+ * 
+ * @param arena arena of the calling thread, locked
+ * @param size aligned block size
+ * @return sf_block* allocated block, NULL if the list is empty
+ */
+sf_block *quick_get(sf_arena *arena, size_t size)
+{
+    if (size > QUICK_MAX_SIZE)
+        return NULL;
+
+    int index = QUICK_INDEX(size);
+    sf_block *block = arena->quick_lists[index];
+    if (block == NULL)
+        return NULL;
+
+    arena->quick_lists[index] = block->body.links.next;
+    arena->quick_counts[index]--;
+    block->body.links.prev = NULL;
+    return block;
+}
+
+/**
+ * @brief Puts a block being freed on the quick lists of its arena
+ * instead of coalescing it. Consolidates the arena when the list
+ * overflows. Aborts if the block is already listed.
+ * 
+ * @param arena arena owning the block, locked
+ * @param block allocated block
+ * @return int 1 if the block was listed, 0 if it is too large
+ */
+int quick_put(sf_arena *arena, sf_block *block)
+{
+    size_t size = get_size(block);
+    if (size > QUICK_MAX_SIZE)
+        return 0;
+
+    int index = QUICK_INDEX(size);
+    if (block->body.links.prev == QUICK_KEY(arena))
+    {
+        for (sf_block *listed = arena->quick_lists[index]; listed != NULL; listed = listed->body.links.next)
+        {
+            if (listed == block)
+                abort();
+        }
+    }
+
+    block->body.links.next = arena->quick_lists[index];
+    block->body.links.prev = QUICK_KEY(arena);
+    arena->quick_lists[index] = block;
+    if (++arena->quick_counts[index] > QUICK_LIST_MAX)
+        quick_consolidate(arena);
+    return 1;
+}
+
+/**
+ * @brief Frees every block on the quick lists of an arena back to
+ * its free lists, coalescing each with its free neighbours.
+ * 
+ * @param arena locked arena
+ * @return int number of blocks freed
+ */
+int quick_consolidate(sf_arena *arena)
+{
+    int freed = 0;
+    for (int i = 0; i < QUICK_LISTS; i++)
+    {
+        sf_block *block = arena->quick_lists[i];
+        while (block != NULL)
+        {
+            sf_block *next = block->body.links.next;
+            free_block(block);
+            coalesce(block);
+            block = next;
+        }
+        freed += arena->quick_counts[i];
+        arena->quick_lists[i] = NULL;
+        arena->quick_counts[i] = 0;
+    }
+    if (freed > 0)
+        debug("consolidated %d blocks", freed);
+    return freed;
+}
@@ -0,0 +1,109 @@
+#include <errno.h>
+#include <stdint.h>
+#include "sfmm.h"
+#include "region.h"
+
+#define REGION_ROUND(size) (((size) + REGION_ALIGN - 1) & ~(size_t)(REGION_ALIGN - 1))
+#define REGION_HEADER_SIZE REGION_ROUND(sizeof(struct sf_region))
+#define CHUNK_HEADER_SIZE REGION_ROUND(sizeof(sf_region_chunk))
+
+sf_region *sf_region_create(size_t chunk_size)
+{
+    if (chunk_size == 0)
+        chunk_size = REGION_CHUNK_SIZE;
+    if (chunk_size < REGION_CHUNK_MIN)
+        chunk_size = REGION_CHUNK_MIN;
+
+    sf_region *region = sf_malloc(chunk_size);
+    if (region == NULL)
+        return NULL;
+
+    region->chunks = NULL;
+    region->chunk_size = chunk_size;
+    region->cursor = (char *)region + REGION_HEADER_SIZE;
+    region->limit = (char *)region + sf_malloc_usable_size(region);
+    return region;
+}
+
+/**
+ * @brief Adds a chunk to a region.
+ *
+ * @param region
+ * @param size bytes needed after the chunk header
+ * @return sf_region_chunk* NULL if the chunk could not be allocated
+ */
+static sf_region_chunk *add_chunk(sf_region *region, size_t size)
+{
+    sf_region_chunk *chunk = sf_malloc(CHUNK_HEADER_SIZE + size);
+    if (chunk == NULL)
+        return NULL;
+    chunk->size = sf_malloc_usable_size(chunk);
+    chunk->next = region->chunks;
+    region->chunks = chunk;
+    return chunk;
+}
+
+void *sf_region_alloc(sf_region *region, size_t size)
+{
+    if (size == 0)
+        return NULL;
+    if (size > SIZE_MAX - CHUNK_HEADER_SIZE - REGION_ALIGN)
+    {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    size = REGION_ROUND(size);
+
+    if (size <= (size_t)(region->limit - region->cursor))
+    {
+        void *pp = region->cursor;
+        region->cursor += size;
+        return pp;
+    }
+
+    // A large object gets a chunk of its own and objects keep being bumped from the current one
+    if (size > region->chunk_size / 4)
+    {
+        sf_region_chunk *chunk = add_chunk(region, size);
+        return (chunk == NULL) ? NULL : (char *)chunk + CHUNK_HEADER_SIZE;
+    }
+
+    sf_region_chunk *chunk = add_chunk(region, region->chunk_size - CHUNK_HEADER_SIZE);
+    if (chunk == NULL)
+        return NULL;
+    region->cursor = (char *)chunk + CHUNK_HEADER_SIZE + size;
+    region->limit = (char *)chunk + chunk->size;
+    return (char *)chunk + CHUNK_HEADER_SIZE;
+}
+
+/**
+ * @brief Frees every chunk of a region but the first.
+ *
+ * @param region
+ */
+static void free_chunks(sf_region *region)
+{
+    sf_region_chunk *chunk = region->chunks;
+    while (chunk != NULL)
+    {
+        sf_region_chunk *next = chunk->next;
+        sf_free(chunk);
+        chunk = next;
+    }
+    region->chunks = NULL;
+}
+
+void sf_region_reset(sf_region *region)
+{
+    free_chunks(region);
+    region->cursor = (char *)region + REGION_HEADER_SIZE;
+    region->limit = (char *)region + sf_malloc_usable_size(region);
+}
+
+void sf_region_destroy(sf_region *region)
+{
+    if (region == NULL)
+        return;
+    free_chunks(region);
+    sf_free(region);
+}
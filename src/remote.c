@@ -0,0 +1,51 @@
+#include <stdlib.h>
+#include "sfmm.h"
+#include "mem.h"
+#include "heap.h"
+#include "arena.h"
+#include "remote.h"
+#include "debug.h"
+
+/**
+ * @brief Queues a block freed by a thread of another arena.
+ * 
+ * @param arena arena owning the block, not locked
+ * @param block allocated block
+ */
+void remote_push(sf_arena *arena, sf_block *block)
+{
+    sf_block *head = __atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED);
+    do
+    {
+        block->body.links.next = head;
+    } while (!__atomic_compare_exchange_n(&arena->remote_frees, &head, block, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**
+ * @brief Frees and coalesces every block on the remote-free queue
+ * of an arena.
+ * 
+ * @param arena locked
+ * @return int number of blocks freed
+ */
+int remote_drain(sf_arena *arena)
+{
+    if (__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED) == NULL)
+        return 0;
+
+    int count = 0;
+    sf_block *block = __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_ACQUIRE);
+    while (block != NULL)
+    {
+        sf_block *next = block->body.links.next;
+        if (!validate_block(block))
+            abort();
+        free_block(block);
+        coalesce(block);
+        block = next;
+        count++;
+    }
+    debug("drained %d remote frees of arena %d", count, arena->index);
+    return count;
+}
@@ -1,97 +1,777 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include "debug.h"
 #include "sfmm.h"
 #include "mem.h"
 #include "heap.h"
+#include "arena.h"
+#include "opts.h"
+#include "tcache.h"
+#include "slab.h"
+#include "mapped.h"
+#include "stats.h"
+#include "backend.h"
+#include "quick.h"
+#include "remote.h"
+#include "profile.h"
 
-void *sf_malloc(size_t size)
+struct sf_options sf_opts;
+
+/* Blocks up to this size are cleared by sf_calloc() without looking for fresh memory. */
+#define CALLOC_FRESH_MIN PAGE_SZ
+
+/**
+ * @brief Coalesces the blocks on the quick lists and the remote-free
+ * queues of every arena.
+ */
+static void consolidate_all()
 {
-    if (size == 0)
-        return NULL;
+    for (int i = 0; i < NUM_ARENAS_MAX; i++)
+    {
+        sf_arena *arena = &sf_arenas[i];
+        if (__atomic_load_n(&arena->free_list_heads, __ATOMIC_ACQUIRE) == NULL)
+            continue;
+
+        arena_lock(arena);
+        remote_drain(arena);
+        quick_consolidate(arena);
+        arena_unlock(arena);
+    }
+}
 
-    size += HEADER_SIZE; // Account for header
+int sf_mallopt(int param, long value)
+{
+    switch (param)
+    {
+    case SF_OPT_TCACHE:
+        if (sf_opts.tcache && !value)
+            tcache_flush_all();
+        sf_opts.tcache = (value != 0);
+        return 1;
+    case SF_OPT_ARENA_MAX:
+        if (arena_set_max(value))
+            return 1;
+        break;
+    case SF_OPT_SLAB:
+        sf_opts.slab = (value != 0);
+        return 1;
+    case SF_OPT_MMAP_THRESHOLD:
+        if (value < 0)
+            break;
+        sf_opts.mmap_threshold = value;
+        return 1;
+    case SF_OPT_TRIM_THRESHOLD:
+        if (value < 0)
+            break;
+        sf_opts.trim_threshold = value;
+        return 1;
+    case SF_OPT_HEAP_MAX:
+        if (value > 0 && sf_mem_set_max(value) == 0)
+            return 1;
+        break;
+    case SF_OPT_BACKEND:
+        if (value == SF_BACKEND_MMAP && sf_mem_set_backend(&sf_mmap_backend) == 0)
+            return 1;
+        if (value == SF_BACKEND_MALLOC && sf_mem_set_backend(&sf_malloc_backend) == 0)
+            return 1;
+        if (value == SF_BACKEND_THP && sf_mem_set_backend(&sf_thp_backend) == 0)
+            return 1;
+        if (value == SF_BACKEND_HUGETLB && sf_mem_set_backend(&sf_hugetlb_backend) == 0)
+            return 1;
+        break;
+    case SF_OPT_DEFER_COALESCE:
+        if (sf_opts.defer_coalesce && !value)
+            consolidate_all();
+        sf_opts.defer_coalesce = (value != 0);
+        return 1;
+    case SF_OPT_PROFILE_RATE:
+        if (value < 0)
+            break;
+        sf_opts.profile_rate = value;
+        return 1;
+    case SF_OPT_PERCPU_ARENAS:
+        sf_opts.percpu_arenas = (value != 0);
+        return 1;
+    case SF_OPT_REMOTE_FREE:
+        if (sf_opts.remote_free && !value)
+            consolidate_all();
+        sf_opts.remote_free = (value != 0);
+        return 1;
+    }
+    sf_errno = EINVAL;
+    return 0;
+}
 
-    // Make sure it is 64 bit aligned
-    if (size % ALIGNMENT_SIZE != 0)
-        size += ALIGNMENT_SIZE - (size % ALIGNMENT_SIZE);
-    
-    // If requested size is less than 64, set it to 64
-    size = (size < ALIGNMENT_SIZE) ? ALIGNMENT_SIZE : size;
+/*
+ * Memory that sf_calloc() does not have to clear: from the fresh mark of the arena on,
+ * and the pages the free block it got had released.
+ */
+typedef struct known_zero {
+    void *fresh;
+    void *released;
+    void *released_end;
+} known_zero;
 
-    if (sf_mem_start() == sf_mem_end())
+/**
+ * @brief Allocates a block from the heap of an arena.
+ *
+ * @param arena
+ * @param size aligned block size
+ * @param align alignment of the payload, a power of two
+ * @param zero if not NULL, set to what is known to read as zeros
+ * before the allocation
+ * @return void* payload, NULL if the heap of the arena is exhausted
+ */
+static void *arena_malloc(sf_arena *arena, size_t size, size_t align, known_zero *zero)
+{
+    arena_lock(arena);
+    if (arena_start(arena) == arena_end(arena))
     {
-        if (init_heap() == -1)
+        if (init_heap(arena) == -1)
         {
+            arena_unlock(arena);
             return NULL;
         }
     }
+    remote_drain(arena);
+    if (zero != NULL)
+    {
+        zero->fresh = arena_fresh(arena);
+        zero->released = NULL;
+    }
 
-    sf_block *raw_block = find_block(size);
+    if (align > ALIGNMENT_SIZE)
+    {
+        sf_block *aligned = find_aligned_block(arena, size, align);
+        arena_unlock(arena);
+        return (aligned == NULL) ? NULL : &aligned->body.payload;
+    }
+
+    if (sf_opts.defer_coalesce)
+    {
+        sf_block *listed = quick_get(arena, size);
+        if (listed != NULL)
+        {
+            arena_unlock(arena);
+            return &listed->body.payload;
+        }
+    }
+
+    sf_block *raw_block = find_block(arena, size);
 
     if (raw_block == NULL)
     {
+        arena_unlock(arena);
         return NULL;
     }
-    size_t allocated_size = raw_block->header | THIS_BLOCK_ALLOCATED;
-    raw_block->header = allocated_size;
-    set_footer(raw_block, allocated_size);
-
-    split(raw_block, size);
+    if (zero != NULL)
+        zero->released = released_pages_of(raw_block, &zero->released_end);
+    place(raw_block, size);
+    arena_unlock(arena);
     return &raw_block->body.payload;
 }
 
-void sf_free(void *pp)
+/**
+ * @brief sf_malloc() without the statistics, for allocations made on
+ * behalf of other calls.
+ *
+ * @param size requested size
+ * @return void* payload
+ */
+static void *allocate(size_t size)
 {
-    // Pointer comes from payload so we need to go to the beginning
-    pp -= (2 * HEADER_SIZE);
+    if (size == 0)
+        return NULL;
 
-    if (!validate_block(pp)) {
+    if (sf_opts.slab && size <= SLAB_MAX_OBJECT)
+        return slab_alloc(size);
+
+    if (sf_opts.mmap_threshold != 0 && size >= sf_opts.mmap_threshold)
+        return mapped_alloc(size);
+
+    size = align_size(size);
+    if (size == 0)
+    {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+
+    if (sf_opts.tcache && size <= TCACHE_MAX_SIZE)
+    {
+        sf_block *cached = tcache_get(size);
+        if (cached != NULL)
+            return &cached->body.payload;
+    }
+
+    // A full secondary arena hands the request over to the main arena
+    sf_arena *arena = arena_get();
+    void *pp = arena_malloc(arena, size, ALIGNMENT_SIZE, NULL);
+    if (pp == NULL && arena != &main_arena)
+        pp = arena_malloc(&main_arena, size, ALIGNMENT_SIZE, NULL);
+    return pp;
+}
+
+void *sf_malloc(size_t size)
+{
+    void *pp = allocate(size);
+    if (pp != NULL)
+    {
+        stats_count(mallocs, 1);
+        profile_malloc(pp, size);
+    }
+    return pp;
+}
+
+void *sf_memalign(size_t align, size_t size)
+{
+    if (align == 0 || (align & (align - 1)) != 0)
+    {
+        sf_errno = EINVAL;
+        return NULL;
+    }
+    if (size == 0)
+        return NULL;
+
+    // Mapped blocks are ALIGNMENT_SIZE-aligned, slab objects are not even that
+    if (align <= ALIGNMENT_SIZE && size > SLAB_MAX_OBJECT)
+        return sf_malloc(size);
+
+    size = align_size(size);
+    if (size == 0 || size > SIZE_MAX - align - ALIGNMENT_SIZE)
+    {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+
+    sf_arena *arena = arena_get();
+    void *pp = arena_malloc(arena, size, align, NULL);
+    if (pp == NULL && arena != &main_arena)
+        pp = arena_malloc(&main_arena, size, align, NULL);
+    if (pp != NULL)
+    {
+        stats_count(mallocs, 1);
+        profile_malloc(pp, size);
+    }
+    return pp;
+}
+
+void *sf_calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+    {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    size_t total = count * size;
+    if (total == 0)
+        return NULL;
+
+    // Mappings are always fresh
+    if (sf_opts.mmap_threshold != 0 && total >= sf_opts.mmap_threshold)
+    {
+        void *pp = mapped_alloc(total);
+        if (pp != NULL)
+        {
+            stats_count(mallocs, 1);
+            profile_malloc(pp, total);
+        }
+        return pp;
+    }
+
+    // Small blocks are most likely reused, so they are simply cleared
+    size_t block_size = align_size(total);
+    if (block_size <= CALLOC_FRESH_MIN)
+    {
+        void *pp = sf_malloc(total);
+        if (pp != NULL)
+            memset(pp, 0, total);
+        return pp;
+    }
+    if (block_size == 0)
+    {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+
+    known_zero zero;
+    sf_arena *arena = arena_get();
+    char *pp = arena_malloc(arena, block_size, ALIGNMENT_SIZE, &zero);
+    if (pp == NULL && arena != &main_arena)
+        pp = arena_malloc(&main_arena, block_size, ALIGNMENT_SIZE, &zero);
+    if (pp == NULL)
+        return NULL;
+
+    // Past the fresh mark, only the links of the free block and the footer
+    // before the epilogue were written
+    size_t dirty = ((void *)pp < zero.fresh) ? (size_t)((char *)zero.fresh - pp) : 0;
+    if (dirty < FREE_LINKS_SIZE)
+        dirty = FREE_LINKS_SIZE;
+    if (dirty > total)
+        dirty = total;
+
+    // Below it, the pages the block released have not been written either
+    size_t skip_start = dirty, skip_end = dirty;
+    if (zero.released != NULL && (char *)zero.released < pp + dirty)
+    {
+        skip_start = (char *)zero.released - pp;
+        skip_end = ((char *)zero.released_end < pp + dirty) ? (size_t)((char *)zero.released_end - pp) : dirty;
+    }
+    memset(pp, 0, skip_start);
+    memset(pp + skip_end, 0, dirty - skip_end);
+
+    size_t footer = get_size((sf_block *)(pp - 2 * HEADER_SIZE)) - 2 * HEADER_SIZE;
+    if (footer >= dirty && footer < total)
+        memset(pp + footer, 0, (total - footer < sizeof(sf_footer)) ? total - footer : sizeof(sf_footer));
+    sf_count_add(calloc_fresh_bytes, total - dirty + (skip_end - skip_start));
+    stats_count(mallocs, 1);
+    profile_malloc(pp, total);
+    return pp;
+}
+
+/**
+ * @brief Frees an allocated block of an arena's heap: into the thread
+ * cache or a quick list, or back to the free lists.
+ *
+ * @param block block whose header has been checked with validate_header()
+ * @param check_neighbours nonzero to check the block against the previous
+ * block too, which needs the arena lock. Cached blocks get that check when
+ * the cache gives them back.
+ */
+static void heap_free(sf_block *block, int check_neighbours)
+{
+    if (sf_opts.tcache && tcache_put(block))
+        return;
+
+    // Blocks go back to the arena they came from
+    sf_arena *arena = arena_of(block);
+    if (arena == NULL) {
+        abort();
+    }
+    if (sf_opts.remote_free && arena != arena_current()) {
+        remote_push(arena, block);
+        return;
+    }
+    arena_lock(arena);
+    if (check_neighbours && !validate_block(block)) {
         abort();
     }
-    sf_block *block = (sf_block*)pp;
+    if (sf_opts.defer_coalesce && quick_put(arena, block)) {
+        arena_unlock(arena);
+        return;
+    }
+    size_t block_size = get_size(block);
     // Update current allocated bit and next block's prev_alloc bit
     free_block(block);
 
-    coalesce(block);
-    return;
+    block = coalesce(block);
+    if (sf_opts.trim_threshold != 0 && block_size >= sf_opts.trim_threshold)
+    {
+        // Give the memory back, by shrinking the heap if the block is last
+        if (trim_heap(arena, 0) == 0)
+            release_block(block);
+    }
+    arena_unlock(arena);
 }
 
-void *sf_realloc(void *pp, size_t rsize)
+/**
+ * @brief sf_free() without the statistics.
+ *
+ * @param pp payload
+ */
+static void deallocate(void *pp)
 {
-    if (rsize == 0) {
-        sf_free(pp);
-        return NULL;
+    sf_slab *slab = slab_of(pp);
+    if (slab != NULL) {
+        slab_free(slab, pp);
+        return;
     }
+    if (is_mapped(pp)) {
+        mapped_free(pp);
+        return;
+    }
+
+    // Pointer comes from payload so we need to go to the beginning
+    pp -= (2 * HEADER_SIZE);
+
+    if (!validate_header(pp)) {
+        abort();
+    }
+    heap_free(pp, 1);
+}
+
+void sf_free(void *pp)
+{
+    stats_count(frees, 1);
+    profile_free(pp);
+    deallocate(pp);
+}
+
+void sf_free_sized(void *pp, size_t size)
+{
+    if (pp == NULL)
+        return;
+    stats_count(frees, 1);
+    profile_free(pp);
+    sf_slab *slab = slab_of(pp);
+    if (slab != NULL) {
+        if (size > slab->object_size)
+            abort();
+        slab_free(slab, pp);
+        return;
+    }
+    if (is_mapped(pp)) {
+        if (size > mapped_size(pp))
+            abort();
+        mapped_free(pp);
+        return;
+    }
+
+    // The block is as large as the request rounded up, plus a remainder
+    // too small to be split off
+    sf_block *block = pp - 2 * HEADER_SIZE;
+    if (!validate_header(block)) {
+        abort();
+    }
+    size_t block_size = get_size(block);
+    size_t expected = align_size(size);
+    if (expected == 0 || block_size < expected || block_size - expected >= ALIGNMENT_SIZE) {
+        abort();
+    }
+    heap_free(block, 0);
+}
+
+size_t sf_malloc_usable_size(void *pp)
+{
+    if (pp == NULL)
+        return 0;
+    sf_slab *slab = slab_of(pp);
+    if (slab != NULL)
+        return slab->object_size;
+    if (is_mapped(pp))
+        return mapped_size(pp);
+
+    // Allocated blocks have no footer, so the payload runs up to the next header
+    pp -= 2 * HEADER_SIZE;
+    if (!validate_header(pp))
+        abort();
+    return get_size(pp) - HEADER_SIZE;
+}
+
+/**
+ * @brief Carves up to count allocated blocks of the same size out of
+ * free blocks of an arena, taking each free block from the free lists
+ * once for as many blocks as fit in it.
+ *
+ * @param arena
+ * @param size aligned block size
+ * @param count number of blocks wanted
+ * @param out filled with the payloads
+ * @return size_t number of blocks allocated
+ */
+static size_t arena_malloc_batch(sf_arena *arena, size_t size, size_t count, void **out)
+{
+    size_t done = 0;
+    arena_lock(arena);
+    if (arena_start(arena) == arena_end(arena) && init_heap(arena) == -1)
+    {
+        arena_unlock(arena);
+        return 0;
+    }
+    while (done < count)
+    {
+        size_t wanted = count - done;
+        if (wanted > SIZE_MAX / size)
+            wanted = SIZE_MAX / size;
+
+        // Settle for whatever free block fits one more when the whole run does not fit
+        sf_block *block = find_block(arena, wanted * size);
+        if (block == NULL)
+            block = find_block(arena, size);
+        if (block == NULL)
+            break;
+
+        size_t left = get_size(block);
+        size_t fit = left / size;
+        if (fit > wanted)
+            fit = wanted;
+        size_t prev_allocated = block->header & PREV_BLOCK_ALLOCATED;
+        for (size_t i = 1; i < fit; i++)
+        {
+            block->header = size | THIS_BLOCK_ALLOCATED | prev_allocated;
+            out[done++] = &block->body.payload;
+            block = (void *)block + size;
+            left -= size;
+            prev_allocated = PREV_BLOCK_ALLOCATED;
+        }
+
+        // The last block takes what is left and splits off the remainder
+        block->header = left | prev_allocated;
+        place(block, size);
+        out[done++] = &block->body.payload;
+    }
+    arena_unlock(arena);
+    return done;
+}
+
+size_t sf_malloc_batch(size_t size, size_t count, void **out)
+{
+    if (size == 0 || count == 0)
+        return 0;
+
+    // Slabs, thread caches and mappings have no runs to carve from
+    size_t block_size = align_size(size);
+    if ((sf_opts.slab && size <= SLAB_MAX_OBJECT) ||
+        (sf_opts.mmap_threshold != 0 && size >= sf_opts.mmap_threshold) || block_size == 0)
+    {
+        size_t done = 0;
+        while (done < count && (out[done] = sf_malloc(size)) != NULL)
+            done++;
+        return done;
+    }
+
+    sf_arena *arena = arena_get();
+    size_t done = arena_malloc_batch(arena, block_size, count, out);
+    if (done < count && arena != &main_arena)
+        done += arena_malloc_batch(&main_arena, block_size, count - done, out + done);
+    stats_count(mallocs, done);
+    for (size_t i = 0; i < done; i++)
+        profile_malloc(out[i], size);
+    if (done < count)
+        sf_errno = ENOMEM;
+    return done;
+}
+
+static void sift_down(void **ptrs, size_t parent, size_t count)
+{
+    for (size_t child; (child = 2 * parent + 1) < count; parent = child)
+    {
+        if (child + 1 < count && ptrs[child + 1] > ptrs[child])
+            child++;
+        if (ptrs[parent] >= ptrs[child])
+            return;
+        void *swap = ptrs[parent];
+        ptrs[parent] = ptrs[child];
+        ptrs[child] = swap;
+    }
+}
+
+/**
+ * @brief Sorts pointers by address in place. A heapsort, since it
+ * neither allocates nor recurses.
+ *
+ * @param ptrs
+ * @param count
+ */
+static void sort_by_address(void **ptrs, size_t count)
+{
+    for (size_t i = count / 2; i-- > 0; )
+        sift_down(ptrs, i, count);
+    for (size_t end = count; end-- > 1; )
+    {
+        void *top = ptrs[0];
+        ptrs[0] = ptrs[end];
+        ptrs[end] = top;
+        sift_down(ptrs, 0, end);
+    }
+}
+
+/**
+ * @brief Frees a run of allocated blocks that follow each other in the
+ * heap as one block, so it goes through coalesce() only once.
+ *
+ * @param arena arena owning the blocks, locked
+ * @param first first block of the run
+ * @param size total size of the run
+ */
+static void free_run(sf_arena *arena, sf_block *first, size_t size)
+{
+    first->header = size | THIS_BLOCK_ALLOCATED | (first->header & PREV_BLOCK_ALLOCATED);
+    free_block(first);
+
+    sf_block *block = coalesce(first);
+    if (sf_opts.trim_threshold != 0 && size >= sf_opts.trim_threshold)
+    {
+        if (trim_heap(arena, 0) == 0)
+            release_block(block);
+    }
+}
+
+void sf_free_batch(void **ptrs, size_t count)
+{
+    sort_by_address(ptrs, count);
+
+    sf_arena *locked = NULL;
+    sf_block *run = NULL;
+    size_t run_size = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        void *pp = ptrs[i];
+        if (pp == NULL)
+            continue;
+        if (i > 0 && pp == ptrs[i - 1])
+            abort();
+
+        sf_block *block = pp - 2 * HEADER_SIZE;
+        sf_arena *arena = NULL;
+        if (slab_of(pp) == NULL && !is_mapped(pp))
+        {
+            if (!validate_header(block))
+                abort();
+            arena = arena_of(block);
+        }
+
+        // A block that does not extend the run ends it
+        if (run != NULL && (arena != locked || block != (void *)run + run_size))
+        {
+            free_run(locked, run, run_size);
+            run = NULL;
+        }
+        if (arena != locked)
+        {
+            if (locked != NULL)
+                arena_unlock(locked);
+            if (arena != NULL)
+                arena_lock(arena);
+            locked = arena;
+        }
+
+        if (arena == NULL)
+        {
+            sf_free(pp);
+            continue;
+        }
+        if (!validate_block(block))
+            abort();
+        profile_free(pp);
+        if (run == NULL)
+        {
+            run = block;
+            run_size = 0;
+        }
+        run_size += get_size(block);
+        stats_count(frees, 1);
+    }
+    if (run != NULL)
+        free_run(locked, run, run_size);
+    if (locked != NULL)
+        arena_unlock(locked);
+}
+
+int sf_trim(size_t pad)
+{
+    size_t released = 0;
+
+    if (sf_opts.tcache)
+        tcache_flush_all();
+
+    for (int i = 0; i < NUM_ARENAS_MAX; i++)
+    {
+        sf_arena *arena = &sf_arenas[i];
+        if (__atomic_load_n(&arena->free_list_heads, __ATOMIC_ACQUIRE) == NULL)
+            continue;
+
+        arena_lock(arena);
+        if (arena_start(arena) != arena_end(arena))
+        {
+            remote_drain(arena);
+            quick_consolidate(arena);
+            released += trim_heap(arena, pad);
+            released += release_free_blocks(arena);
+        }
+        arena_unlock(arena);
+    }
+    return released != 0;
+}
+
+/**
+ * @brief sf_realloc() of a nonzero size without the profiling.
+ *
+ * @param pp payload
+ * @param rsize requested size
+ * @return void* payload of the resized block
+ */
+static void *reallocate(void *pp, size_t rsize)
+{
+    sf_slab *slab = slab_of(pp);
+    if (slab != NULL) {
+        if (rsize <= slab->object_size)
+            return pp;
+        void *moved = allocate(rsize);
+        if (moved != NULL) {
+            memcpy(moved, pp, slab->object_size);
+            slab_free(slab, pp);
+        }
+        return moved;
+    }
+    if (is_mapped(pp))
+        return mapped_realloc(pp, rsize);
     // Get to beginning of block
     pp -= 2 * HEADER_SIZE;
+    if (!validate_header(pp)) {
+        abort();
+    }
+    sf_arena *arena = arena_of(pp);
+    arena_lock(arena);
     if (!validate_block(pp)) {
         abort();
     }
 
     size_t block_size = get_size(pp);
+    size_t new_size = align_size(rsize);
+    if (new_size == 0) {
+        arena_unlock(arena);
+        sf_errno = ENOMEM;
+        return NULL;
+    }
 
     // Decrease size
-    if (rsize < block_size) {
-        rsize += HEADER_SIZE; // Account for header
-
-        // Make sure it is 64 bit aligned
-        if (rsize % ALIGNMENT_SIZE != 0)
-            rsize += ALIGNMENT_SIZE - (rsize % ALIGNMENT_SIZE);
-        
-        rsize = (rsize < ALIGNMENT_SIZE) ? ALIGNMENT_SIZE : rsize;
-        split(pp, rsize);
+    if (new_size <= block_size) {
+        split(pp, new_size);
+        arena_unlock(arena);
         return (pp + (2 * HEADER_SIZE));
     }
-    else if (rsize == block_size){
+
+    // Increase size in place if possible
+    if (grow_in_place(arena, pp, new_size) == 0) {
+        arena_unlock(arena);
+        sf_count(realloc_in_place);
         return pp + (2 * HEADER_SIZE);
     }
+    arena_unlock(arena);
 
     // Increase size
-    void *increased_block = sf_malloc(rsize);
+    void *increased_block = allocate(rsize);
+    if (increased_block == NULL)
+        return NULL;
     pp += (2 * HEADER_SIZE);               // Get to payload
-    memcpy(increased_block, pp, block_size);
-    sf_free(pp);
+    memcpy(increased_block, pp, block_size - HEADER_SIZE);
+    deallocate(pp);
+    sf_count(realloc_copied);
     return increased_block;
 }
+
+void *sf_realloc(void *pp, size_t rsize)
+{
+    if (rsize == 0) {
+        sf_free(pp);
+        return NULL;
+    }
+    // The sample is out of the table while the old block may be freed, so that
+    // a block given the same address by another thread keeps its own sample
+    struct profile_entry *sample = profile_tracked(pp) ? profile_detach(pp) : NULL;
+    size_t old_size = (sample != NULL) ? sf_malloc_usable_size(pp) : 0;
+    void *resized = reallocate(pp, rsize);
+
+    // A sampled block keeps its sample unless it moved or changed size,
+    // then it gets a new chance of being sampled like any other block
+    if (resized == NULL || (sample != NULL && resized == pp && sf_malloc_usable_size(resized) == old_size))
+    {
+        profile_reattach(sample);
+        return resized;
+    }
+    profile_discard(sample);
+    profile_malloc(resized, rsize);
+    return resized;
+}
@@ -0,0 +1,307 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "sfmm.h"
+#include "mem.h"
+#include "backend.h"
+
+int sf_errno;
+struct sf_block sf_free_list_heads[NUM_FREE_LISTS];
+
+/* If nonzero, the sf_show_* functions print nothing. */
+int sf_util_quiet;
+
+static const sf_backend *mem_backend = &sf_mmap_backend;
+static size_t mem_max = SF_HEAP_MAX_DEFAULT;
+static void *mem_start;
+static void *mem_end;
+static void *mem_committed;
+/* Memory from here to the end of the reservation has not been written since it was committed. */
+static void *mem_dirty_end;
+
+static pthread_once_t mem_once = PTHREAD_ONCE_INIT;
+static int mem_ready;
+
+/**
+ * @brief Reserves the range of the heap the first time it is used,
+ * going down the chain of fallbacks until a backend succeeds. If none
+ * does the heap stays empty and every sf_mem_grow() fails.
+ */
+static void mem_init()
+{
+    void *start = NULL;
+    for (; mem_backend != NULL; mem_backend = mem_backend->fallback)
+    {
+        size_t granularity = mem_backend->granularity;
+        size_t size = (mem_max + granularity - 1) / granularity * granularity;
+        start = mem_backend->reserve(size);
+        if (start != NULL)
+        {
+            mem_max = size;
+            break;
+        }
+    }
+    mem_start = start;
+    mem_end = start;
+    mem_committed = start;
+    mem_dirty_end = (start == NULL || mem_backend->zeroed) ? start : start + mem_max;
+    __atomic_store_n(&mem_ready, 1, __ATOMIC_RELEASE);
+}
+
+void *sf_mem_start()
+{
+    pthread_once(&mem_once, mem_init);
+    return mem_start;
+}
+
+void *sf_mem_end()
+{
+    pthread_once(&mem_once, mem_init);
+    return __atomic_load_n(&mem_end, __ATOMIC_ACQUIRE);
+}
+
+void *sf_mem_grow()
+{
+    pthread_once(&mem_once, mem_init);
+
+    void *page = mem_end;
+    if (page == NULL || (size_t)(page - mem_start) + PAGE_SZ > mem_max)
+    {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+
+    // Commit a whole granule of the backend once the heap runs past what is committed
+    if (page + PAGE_SZ > mem_committed)
+    {
+        size_t size = mem_backend->granularity;
+        if (mem_backend->commit(mem_committed, size) == -1)
+        {
+            sf_errno = ENOMEM;
+            return NULL;
+        }
+        mem_committed += size;
+    }
+    if (page + PAGE_SZ > mem_dirty_end)
+        mem_dirty_end = page + PAGE_SZ;
+    __atomic_store_n(&mem_end, page + PAGE_SZ, __ATOMIC_RELEASE);
+    return page;
+}
+
+/**
+ * @brief Gives the given number of bytes at the end of the heap back
+ * to the backend. The counterpart of sf_mem_grow(). With huge pages the
+ * memory only goes back once a whole huge page is unused.
+ *
+ * @param size number of bytes, a multiple of PAGE_SZ
+ * @return int  0 if successful
+ *              -1 if the heap is smaller than that or the backend failed
+ */
+int sf_mem_shrink(size_t size)
+{
+    pthread_once(&mem_once, mem_init);
+
+    if (size > (size_t)(mem_end - mem_start))
+        return -1;
+    void *end = mem_end - size;
+
+    // Only granules the heap no longer reaches into can be decommitted
+    size_t granularity = mem_backend->granularity;
+    void *committed = mem_start + ((size_t)(end - mem_start) + granularity - 1) / granularity * granularity;
+    if (committed < mem_committed && mem_backend->decommit(committed, mem_committed - committed) == -1)
+        return -1;
+    if (committed < mem_committed && mem_dirty_end > committed && mem_backend->zeroed)
+        mem_dirty_end = committed;
+    mem_committed = committed;
+    __atomic_store_n(&mem_end, end, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * @brief Start of the memory at the end of the heap that reads as zeros:
+ * what sf_mem_grow() will hand out next, up to where it has been written
+ * since it was last committed. Never below sf_mem_end().
+ *
+ * @return void*
+ */
+void *sf_mem_fresh()
+{
+    pthread_once(&mem_once, mem_init);
+    return mem_dirty_end;
+}
+
+/**
+ * @brief The backend the main heap ended up with, once the fallbacks
+ * have been tried.
+ *
+ * @return const sf_backend* NULL if no backend could reserve the heap
+ */
+const sf_backend *sf_mem_backend()
+{
+    pthread_once(&mem_once, mem_init);
+    return mem_backend;
+}
+
+/**
+ * @brief Selects where the heap gets its memory from.
+ *
+ * @param backend
+ * @return int  0 if successful
+ *              -1 if backend is NULL or the heap is already in use
+ */
+int sf_mem_set_backend(const sf_backend *backend)
+{
+    if (backend == NULL || __atomic_load_n(&mem_ready, __ATOMIC_ACQUIRE))
+        return -1;
+    mem_backend = backend;
+    return 0;
+}
+
+/**
+ * @brief Sets the maximum size of the heap, rounded up to whole pages
+ * (whole huge pages with a backend of huge pages).
+ *
+ * @param size
+ * @return int  0 if successful
+ *              -1 if size is 0 or the heap is already in use
+ */
+int sf_mem_set_max(size_t size)
+{
+    if (size == 0 || size > SIZE_MAX - PAGE_SZ || __atomic_load_n(&mem_ready, __ATOMIC_ACQUIRE))
+        return -1;
+    mem_max = (size + PAGE_SZ - 1) / PAGE_SZ * PAGE_SZ;
+    return 0;
+}
+
+/* The prologue is placed so that the payload of the first block is 64-byte aligned. */
+static sf_block *prologue()
+{
+    uintptr_t start = (uintptr_t)sf_mem_start();
+    return (sf_block *)(((start + 7 + ALIGNMENT_SIZE) & ~(uintptr_t)(ALIGNMENT_SIZE - 1)) - 16);
+}
+
+static sf_block *epilogue()
+{
+    return sf_mem_end() - 16;
+}
+
+static void show_links(sf_block *bp)
+{
+    fprintf(stderr, "[prev:%p, next:%p]", bp->body.links.prev, bp->body.links.next);
+}
+
+void sf_show_block(sf_block *bp)
+{
+    if (sf_util_quiet)
+        return;
+
+    int alloc = (bp->header & THIS_BLOCK_ALLOCATED) != 0;
+    int prev_alloc = (bp->header & PREV_BLOCK_ALLOCATED) != 0;
+    size_t size = bp->header & ~(size_t)(ALIGNMENT_SIZE - 1);
+
+    fprintf(stderr, "%10p: ", &bp->header);
+    fprintf(stderr, "[%-8s][sz: %8lu, al: %1u, pal: %1u]",
+            alloc ? "USED BLK" : "FREE BLK", size, alloc, prev_alloc);
+    if (!alloc)
+    {
+        show_links(bp);
+        sf_footer footer = *(sf_footer *)((void *)bp + size);
+        if ((void *)&bp->header != sf_mem_end() - 16 && footer != bp->header)
+            fprintf(stderr, "\n\t***FOOTER DOES NOT MATCH HEADER (0x%lx != 0x%lx)***", footer, bp->header);
+    }
+    if (((uintptr_t)&bp->body.payload & (ALIGNMENT_SIZE - 1)) != 0)
+        fprintf(stderr, "\n\t***PAYLOAD ADDRESS (%p) IS NOT ALIGNED***", &bp->body.payload);
+}
+
+static void show_unused(sf_block *bp)
+{
+    fprintf(stderr, "%10p: ", &bp->header);
+    fprintf(stderr, "%-39s\n", "[UNUSED  ]");
+}
+
+static void show_boundary(sf_block *bp, const char *name)
+{
+    fprintf(stderr, "%10p: ", &bp->header);
+    fprintf(stderr, "[%s][sz: %8lu, al: %1u, pal: %1u]", name,
+            bp->header & ~(size_t)(ALIGNMENT_SIZE - 1),
+            (bp->header & THIS_BLOCK_ALLOCATED) != 0, (bp->header & PREV_BLOCK_ALLOCATED) != 0);
+    fputc('\n', stderr);
+}
+
+void sf_show_blocks()
+{
+    if (sf_util_quiet)
+        return;
+
+    show_boundary(prologue(), "PROLOGUE");
+    sf_block *bp = (void *)prologue() + (prologue()->header & ~(size_t)(ALIGNMENT_SIZE - 1));
+    while (bp < epilogue())
+    {
+        sf_show_block(bp);
+        size_t size = bp->header & ~(size_t)(ALIGNMENT_SIZE - 1);
+        if (size == 0)
+        {
+            fprintf(stderr, "***ZERO SIZE BLOCK***\n");
+            return;
+        }
+        bp = (void *)bp + size;
+        fputc('\n', stderr);
+    }
+    show_boundary(epilogue(), "EPILOGUE");
+}
+
+void sf_show_free_list(int index)
+{
+    if (sf_util_quiet)
+        return;
+
+    sf_block *head = &sf_free_list_heads[index];
+    fprintf(stderr, "[%10p]: ", head);
+    int limit = 100;
+    for (sf_block *bp = head->body.links.next; bp != head; bp = bp->body.links.next)
+    {
+        if (--limit < 0)
+        {
+            fprintf(stderr, "Corrupted free list %d\n", index);
+            return;
+        }
+        fprintf(stderr, "\n    ");
+        sf_show_block(bp);
+    }
+}
+
+void sf_show_free_lists()
+{
+    if (sf_util_quiet)
+        return;
+
+    fprintf(stderr, "Free lists:\n");
+    for (int i = 0; i < NUM_FREE_LISTS; i++)
+    {
+        sf_show_free_list(i);
+        fputc('\n', stderr);
+    }
+}
+
+void sf_show_heap()
+{
+    if (sf_util_quiet)
+        return;
+
+    void *start = sf_mem_start();
+    void *end = sf_mem_end();
+    if (start == end)
+    {
+        fprintf(stderr, "UNINITIALIZED HEAP\n\n");
+        return;
+    }
+    fprintf(stderr, "Heap start: %p, end: %p, size: %lu\n", start, end, (size_t)(end - start));
+    if (start < (void *)&prologue()->header)
+        show_unused(start - 8);
+    sf_show_blocks();
+    fputc('\n', stderr);
+    fputc('\n', stderr);
+    sf_show_free_lists();
+    fputc('\n', stderr);
+}
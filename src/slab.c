@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include "sfmm.h"
+#include "mem.h"
+#include "heap.h"
+#include "arena.h"
+#include "slab.h"
+#include "debug.h"
+
+#define SLAB_MAGIC 0x5f736c61625f7366ULL
+
+/* Objects start at the first multiple of ALIGNMENT_SIZE after the header. */
+#define SLAB_HEADER_SIZE ((sizeof(sf_slab) + ALIGNMENT_SIZE - 1) & ~(ALIGNMENT_SIZE - 1))
+
+static const unsigned int slab_sizes[NUM_SLAB_CLASSES] = { 8, 16, 32, 48 };
+
+/* Set once the first slab is made, so sf_free can skip the lookup until then. */
+static int slabs_in_use;
+
+static int slab_class(size_t size)
+{
+    int i = 0;
+    while (slab_sizes[i] < size)
+        i++;
+    return i;
+}
+
+static void slab_push(sf_slab **list, sf_slab *slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list != NULL)
+        (*list)->prev = slab;
+    *list = slab;
+}
+
+static void slab_unlink(sf_slab **list, sf_slab *slab)
+{
+    if (slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        *list = slab->next;
+    if (slab->next != NULL)
+        slab->next->prev = slab->prev;
+}
+
+/**
+ * @brief Carves a new slab for the given class out of an arena's
+ * heap. Must be called with the arena's lock held.
+ * 
+ * @param arena
+ * @param index slab class
+ * @return sf_slab* new slab with every object free, NULL if the heap is exhausted
+ */
+static sf_slab *slab_create(sf_arena *arena, int index)
+{
+    sf_block *block = find_aligned_block(arena, align_size(SLAB_SIZE), SLAB_SIZE);
+    if (block == NULL)
+        return NULL;
+
+    sf_slab *slab = (sf_slab *)&block->body.payload;
+    slab->magic = SLAB_MAGIC;
+    slab->self = slab;
+    slab->object_size = slab_sizes[index];
+    slab->num_objects = (SLAB_SIZE - SLAB_HEADER_SIZE) / slab->object_size;
+    slab->num_free = slab->num_objects;
+    slab->slab_class = index;
+    for (int i = 0; i < SLAB_MAP_WORDS; i++)
+    {
+        int bits = slab->num_objects - i * 64;
+        slab->free_map[i] = (bits >= 64) ? ~(uint64_t)0 : (bits > 0) ? ((uint64_t)1 << bits) - 1 : 0;
+    }
+    __atomic_store_n(&slabs_in_use, 1, __ATOMIC_RELEASE);
+    debug("slab of %u byte objects at %p", slab->object_size, slab);
+    return slab;
+}
+
+/**
+ * @brief Allocates a tiny object from a slab of the calling thread's arena.
+ * 
+ * @param size requested size, at most SLAB_MAX_OBJECT
+ * @return void* the object, NULL if the heap is exhausted
+ */
+void *slab_alloc(size_t size)
+{
+    int index = slab_class(size);
+    sf_arena *arena = arena_get();
+
+    arena_lock(arena);
+    if (arena_start(arena) == arena_end(arena) && init_heap(arena) == -1)
+    {
+        arena_unlock(arena);
+        return NULL;
+    }
+
+    sf_slab *slab = arena->slabs[index];
+    if (slab == NULL)
+    {
+        slab = slab_create(arena, index);
+        if (slab == NULL)
+        {
+            arena_unlock(arena);
+            return NULL;
+        }
+        slab_push(&arena->slabs[index], slab);
+    }
+
+    int word = 0;
+    while (slab->free_map[word] == 0)
+        word++;
+    int bit = __builtin_ctzll(slab->free_map[word]);
+    slab->free_map[word] &= ~((uint64_t)1 << bit);
+
+    // Full slabs are not kept in the list
+    if (--slab->num_free == 0)
+        slab_unlink(&arena->slabs[index], slab);
+    arena_unlock(arena);
+
+    return (void *)slab + SLAB_HEADER_SIZE + (word * 64 + bit) * slab->object_size;
+}
+
+/**
+ * @brief Finds the slab an object was allocated from.
+ * 
+ * @param pp pointer given to sf_free
+ * @return sf_slab* slab owning the object, NULL if pp is not a slab object
+ */
+sf_slab *slab_of(void *pp)
+{
+    if (!__atomic_load_n(&slabs_in_use, __ATOMIC_ACQUIRE))
+        return NULL;
+
+    sf_slab *slab = (sf_slab *)((uintptr_t)pp & ~(uintptr_t)(SLAB_SIZE - 1));
+    if ((void *)slab == pp || arena_of(slab) == NULL)
+        return NULL;
+    if (slab->magic != SLAB_MAGIC || slab->self != slab)
+        return NULL;
+
+    // The slab must still be an allocated block
+    sf_block *block = (void *)slab - 2 * HEADER_SIZE;
+    if (is_free(block) || get_size(block) < SLAB_SIZE)
+        return NULL;
+    return slab;
+}
+
+/**
+ * @brief Returns an object to its slab. A slab whose objects are all
+ * free is freed back to the free lists unless it is the only slab of its
+ * size left in the arena. Aborts if pp is not an allocated object.
+ * 
+ * @param slab slab owning the object
+ * @param pp the object
+ */
+void slab_free(sf_slab *slab, void *pp)
+{
+    size_t offset = pp - (void *)slab - SLAB_HEADER_SIZE;
+    if (pp < (void *)slab + SLAB_HEADER_SIZE || offset % slab->object_size != 0)
+        abort();
+    size_t index = offset / slab->object_size;
+    if (index >= slab->num_objects)
+        abort();
+
+    sf_arena *arena = arena_of(slab);
+    arena_lock(arena);
+    uint64_t mask = (uint64_t)1 << (index % 64);
+    if (slab->free_map[index / 64] & mask)
+        abort();
+    slab->free_map[index / 64] |= mask;
+
+    sf_slab **list = &arena->slabs[slab->slab_class];
+    if (slab->num_free++ == 0)
+        slab_push(list, slab);
+
+    if (slab->num_free == slab->num_objects && (slab->prev != NULL || slab->next != NULL))
+    {
+        slab_unlink(list, slab);
+        slab->magic = 0;
+        sf_block *block = (void *)slab - 2 * HEADER_SIZE;
+        free_block(block);
+        coalesce(block);
+    }
+    arena_unlock(arena);
+}
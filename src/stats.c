@@ -0,0 +1,131 @@
+#include <pthread.h>
+#include <stdio.h>
+#include "sfmm.h"
+#include "mem.h"
+#include "heap.h"
+#include "arena.h"
+#include "stats.h"
+
+struct sf_counters sf_counters;
+__thread struct sf_thread_counters sf_thread_counters;
+
+static pthread_key_t stats_key;
+static pthread_once_t stats_key_once = PTHREAD_ONCE_INIT;
+
+static void stats_destroy(void *arg)
+{
+    stats_flush();
+    // Counts made by later destructors register the thread again
+    sf_thread_counters.registered = 0;
+}
+
+static void stats_make_key()
+{
+    pthread_key_create(&stats_key, stats_destroy);
+}
+
+/**
+ * @brief Makes sure the counts of the calling thread get flushed
+ * when the thread exits.
+ */
+void stats_register()
+{
+    // pthread_setspecific() may allocate, so mark the counters first
+    sf_thread_counters.registered = 1;
+    pthread_once(&stats_key_once, stats_make_key);
+    pthread_setspecific(stats_key, &sf_thread_counters);
+}
+
+/**
+ * @brief Adds the counts of the calling thread to sf_counters.
+ */
+void stats_flush()
+{
+    sf_count_add(mallocs, sf_thread_counters.mallocs);
+    sf_count_add(frees, sf_thread_counters.frees);
+    sf_thread_counters.mallocs = 0;
+    sf_thread_counters.frees = 0;
+    sf_thread_counters.pending = 0;
+}
+
+/**
+ * @brief Adds up the blocks of an arena's heap.
+ *
+ * @param arena arena with a heap, locked
+ * @param stats
+ */
+static void walk_heap(sf_arena *arena, struct sf_stats *stats)
+{
+    void *start = arena_start(arena);
+    void *end = arena_end(arena);
+    stats->heap_bytes += end - start;
+
+    // From the block after the prologue to the epilogue
+    sf_block *prologue = start + 6 * sizeof(size_t);
+    sf_block *epilogue = end - 2 * sizeof(size_t);
+    for (sf_block *block = (void *)prologue + get_size(prologue); block < epilogue; block = get_next_block(block))
+    {
+        size_t size = get_size(block);
+        if (!is_free(block))
+        {
+            stats->in_use_bytes += size;
+            continue;
+        }
+        stats->free_bytes += size;
+        stats->free_bytes_per_class[size_class(size)] += size;
+        if (size > stats->largest_free_block)
+            stats->largest_free_block = size;
+    }
+
+    for (int i = 0; i < QUICK_LISTS; i++)
+        stats->quick_bytes += (size_t)arena->quick_counts[i] * (i + 1) * ALIGNMENT_SIZE;
+}
+
+void sf_get_stats(struct sf_stats *stats)
+{
+    *stats = (struct sf_stats){0};
+    stats_flush();
+
+    for (int i = 0; i < NUM_ARENAS_MAX; i++)
+    {
+        sf_arena *arena = &sf_arenas[i];
+        if (__atomic_load_n(&arena->free_list_heads, __ATOMIC_ACQUIRE) == NULL)
+            continue;
+
+        arena_lock(arena);
+        if (arena_start(arena) != arena_end(arena))
+            walk_heap(arena, stats);
+        arena_unlock(arena);
+    }
+    // Quick-listed blocks look allocated to the walk
+    stats->in_use_bytes -= stats->quick_bytes;
+
+    stats->mallocs = __atomic_load_n(&sf_counters.mallocs, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&sf_counters.frees, __ATOMIC_RELAXED);
+    stats->reallocs_in_place = __atomic_load_n(&sf_counters.realloc_in_place, __ATOMIC_RELAXED);
+    stats->reallocs_copied = __atomic_load_n(&sf_counters.realloc_copied, __ATOMIC_RELAXED);
+    stats->heap_grows = __atomic_load_n(&sf_counters.heap_grows, __ATOMIC_RELAXED);
+    stats->mapped_bytes = __atomic_load_n(&sf_counters.mapped_bytes, __ATOMIC_RELAXED);
+    if (stats->free_bytes != 0)
+        stats->fragmentation = 1 - (double)stats->largest_free_block / stats->free_bytes;
+}
+
+int sf_stats_json(const struct sf_stats *stats, char *buf, size_t size)
+{
+    char classes[NUM_FREE_LISTS * 24];
+    int length = 0;
+    for (int i = 0; i < NUM_FREE_LISTS; i++)
+        length += snprintf(classes + length, sizeof(classes) - length, "%s%zu",
+                           (i == 0) ? "" : ", ", stats->free_bytes_per_class[i]);
+
+    return snprintf(buf, size,
+                    "{\"mallocs\": %zu, \"frees\": %zu, \"reallocs_in_place\": %zu, "
+                    "\"reallocs_copied\": %zu, \"heap_grows\": %zu, \"heap_bytes\": %zu, "
+                    "\"in_use_bytes\": %zu, \"mapped_bytes\": %zu, \"quick_bytes\": %zu, "
+                    "\"free_bytes\": %zu, \"free_bytes_per_class\": [%s], "
+                    "\"largest_free_block\": %zu, \"fragmentation\": %.4f}",
+                    stats->mallocs, stats->frees, stats->reallocs_in_place,
+                    stats->reallocs_copied, stats->heap_grows, stats->heap_bytes,
+                    stats->in_use_bytes, stats->mapped_bytes, stats->quick_bytes,
+                    stats->free_bytes, classes, stats->largest_free_block, stats->fragmentation);
+}
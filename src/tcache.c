@@ -0,0 +1,211 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "sfmm.h"
+#include "mem.h"
+#include "heap.h"
+#include "arena.h"
+#include "tcache.h"
+#include "debug.h"
+
+#define TCACHE_INDEX(size) ((size) / ALIGNMENT_SIZE - 1)
+
+typedef struct tcache_bin {
+    sf_block *head;
+    int count;
+} tcache_bin;
+
+typedef struct tcache {
+    tcache_bin bins[TCACHE_BINS];
+    int registered;
+} tcache;
+
+static __thread tcache thread_cache;
+
+/* Marks cached blocks (in body.links.prev) so double frees can be caught. */
+#define TCACHE_KEY ((sf_block *)&thread_cache)
+
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+static void tcache_destroy(void *arg)
+{
+    tcache_flush_all();
+}
+
+static void tcache_make_key()
+{
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/**
+ * @brief Makes sure the cache of the calling thread gets flushed
+ * when the thread exits.
+ */
+static void tcache_register()
+{
+    // pthread_setspecific() may allocate, so mark the cache first
+    thread_cache.registered = 1;
+    pthread_once(&tcache_key_once, tcache_make_key);
+    pthread_setspecific(tcache_key, &thread_cache);
+}
+
+static void tcache_push(tcache_bin *bin, sf_block *block)
+{
+    block->body.links.next = bin->head;
+    block->body.links.prev = TCACHE_KEY;
+    bin->head = block;
+    bin->count++;
+}
+
+/**
+ * @brief Frees a chain of cached blocks back to the free lists of
+ * their arenas. The lock of an arena is held across consecutive
+ * blocks that belong to it. Aborts if a block is not linked properly
+ * to the previous one.
+ * 
+ * @param block first block of the chain
+ * @param count number of blocks in the chain
+ */
+static void tcache_release(sf_block *block, int count)
+{
+    sf_arena *locked = NULL;
+    while (count-- > 0)
+    {
+        sf_block *next = block->body.links.next;
+        sf_arena *arena = arena_of(block);
+        if (arena != locked)
+        {
+            if (locked != NULL)
+                arena_unlock(locked);
+            arena_lock(arena);
+            locked = arena;
+        }
+        // The link to the previous block could not be checked without the lock
+        if (!validate_block(block))
+            abort();
+        free_block(block);
+        coalesce(block);
+        block = next;
+    }
+    if (locked != NULL)
+        arena_unlock(locked);
+}
+
+/**
+ * @brief Takes up to TCACHE_FILL_COUNT blocks of the given size from
+ * the free lists of the calling thread's arena into its bin. Only the
+ * first block may grow the heap.
+ * 
+ * @param size aligned block size
+ * @return int number of blocks added to the bin
+ */
+static int tcache_refill(size_t size)
+{
+    tcache_bin *bin = &thread_cache.bins[TCACHE_INDEX(size)];
+    int filled = 0;
+
+    if (!thread_cache.registered)
+        tcache_register();
+
+    sf_arena *arena = arena_get();
+    arena_lock(arena);
+    if (arena_start(arena) == arena_end(arena) && init_heap(arena) == -1)
+    {
+        arena_unlock(arena);
+        return 0;
+    }
+    while (filled < TCACHE_FILL_COUNT)
+    {
+        sf_block *block = (filled == 0) ? find_block(arena, size) : search_free_lists(arena, size);
+        if (block == NULL)
+            break;
+        place(block, size);
+        tcache_push(bin, block);
+        filled++;
+    }
+    arena_unlock(arena);
+
+    debug("refilled bin of size %zu with %d blocks", size, filled);
+    return filled;
+}
+
+/**
+ * @brief Gets a block of exactly the given size from the calling
+ * thread's cache, refilling the bin from the free lists if it is empty.
+ * 
+ * @param size aligned block size, at most TCACHE_MAX_SIZE
+ * @return sf_block* allocated block, NULL if the heap is exhausted
+ */
+sf_block *tcache_get(size_t size)
+{
+    tcache_bin *bin = &thread_cache.bins[TCACHE_INDEX(size)];
+
+    if (bin->count == 0 && tcache_refill(size) == 0)
+        return NULL;
+
+    sf_block *block = bin->head;
+    bin->head = block->body.links.next;
+    bin->count--;
+    block->body.links.prev = NULL;
+    return block;
+}
+
+/**
+ * @brief Puts an allocated block into the calling thread's cache.
+ * When the bin is full, its oldest blocks are flushed to the free lists.
+ * Aborts if the block is already in the cache.
+ * 
+ * @param block block being freed
+ * @return int 1 if the block was cached, 0 if it is too large to be cached
+ */
+int tcache_put(sf_block *block)
+{
+    size_t size = get_size(block);
+    if (size > TCACHE_MAX_SIZE)
+        return 0;
+
+    tcache_bin *bin = &thread_cache.bins[TCACHE_INDEX(size)];
+
+    if (block->body.links.prev == TCACHE_KEY)
+    {
+        for (sf_block *cached = bin->head; cached != NULL; cached = cached->body.links.next)
+        {
+            if (cached == block)
+                abort();
+        }
+    }
+
+    if (bin->count >= TCACHE_BIN_MAX)
+    {
+        // Keep the most recently freed blocks, they are the likeliest to be in cache
+        sf_block *last_kept = bin->head;
+        for (int i = 1; i < bin->count - TCACHE_FLUSH_COUNT; i++)
+            last_kept = last_kept->body.links.next;
+
+        tcache_release(last_kept->body.links.next, TCACHE_FLUSH_COUNT);
+        last_kept->body.links.next = NULL;
+        bin->count -= TCACHE_FLUSH_COUNT;
+    }
+
+    if (!thread_cache.registered)
+        tcache_register();
+
+    tcache_push(bin, block);
+    return 1;
+}
+
+/**
+ * @brief Frees every block cached by the calling thread back to
+ * the free lists.
+ */
+void tcache_flush_all()
+{
+    for (int i = 0; i < TCACHE_BINS; i++)
+    {
+        tcache_bin *bin = &thread_cache.bins[i];
+        if (bin->count > 0)
+            tcache_release(bin->head, bin->count);
+        bin->head = NULL;
+        bin->count = 0;
+    }
+}
@@ -0,0 +1,149 @@
+#include "sfmm.h"
+#include "mem.h"
+#include "tree.h"
+
+typedef struct tree_links {
+    sf_block *left;
+    sf_block *right;
+} tree_links;
+
+/* The tree links follow the next and prev free list links. */
+#define LINKS(block) ((tree_links *)(&(block)->body.links + 1))
+#define LEFT(block) (LINKS(block)->left)
+#define RIGHT(block) (LINKS(block)->right)
+
+/**
+ * @brief Heap priority of a block in the treap.
+ * 
+ * @param block 
+ * @return uint64_t 
+ */
+static uint64_t priority(sf_block *block)
+{
+    return ((uintptr_t)block / ALIGNMENT_SIZE) * 0x9e3779b97f4a7c15ULL;
+}
+
+/**
+ * @brief Orders blocks by size, then by address.
+ * 
+ * @return int 1 if a comes before b
+ */
+static int tree_less(sf_block *a, sf_block *b)
+{
+    size_t a_size = get_size(a), b_size = get_size(b);
+    return (a_size != b_size) ? a_size < b_size : a < b;
+}
+
+static sf_block *rotate_right(sf_block *root)
+{
+    sf_block *left = LEFT(root);
+    LEFT(root) = RIGHT(left);
+    RIGHT(left) = root;
+    return left;
+}
+
+static sf_block *rotate_left(sf_block *root)
+{
+    sf_block *right = RIGHT(root);
+    RIGHT(root) = LEFT(right);
+    LEFT(right) = root;
+    return right;
+}
+
+/**
+ * @brief Joins two treaps where every block of the first one
+ * comes before every block of the second one.
+ * 
+ * @return sf_block* root of the joined treap
+ */
+static sf_block *tree_merge(sf_block *a, sf_block *b)
+{
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+    if (priority(a) > priority(b))
+    {
+        RIGHT(a) = tree_merge(RIGHT(a), b);
+        return a;
+    }
+    LEFT(b) = tree_merge(a, LEFT(b));
+    return b;
+}
+
+/**
+ * @brief Inserts a free block into a treap.
+ * 
+ * @param root root of the treap, NULL if empty
+ * @param block block to be inserted
+ * @return sf_block* new root of the treap
+ */
+sf_block *tree_insert(sf_block *root, sf_block *block)
+{
+    if (root == NULL)
+    {
+        LEFT(block) = NULL;
+        RIGHT(block) = NULL;
+        return block;
+    }
+    if (tree_less(block, root))
+    {
+        LEFT(root) = tree_insert(LEFT(root), block);
+        if (priority(LEFT(root)) > priority(root))
+            root = rotate_right(root);
+    }
+    else
+    {
+        RIGHT(root) = tree_insert(RIGHT(root), block);
+        if (priority(RIGHT(root)) > priority(root))
+            root = rotate_left(root);
+    }
+    return root;
+}
+
+/**
+ * @brief Removes a block from a treap. The block's size must not
+ * have changed since it was inserted.
+ * 
+ * @param root root of the treap
+ * @param block block to be removed
+ * @return sf_block* new root of the treap
+ */
+sf_block *tree_remove(sf_block *root, sf_block *block)
+{
+    if (root == NULL)
+        return NULL;
+    if (root == block)
+        return tree_merge(LEFT(root), RIGHT(root));
+    if (tree_less(block, root))
+        LEFT(root) = tree_remove(LEFT(root), block);
+    else
+        RIGHT(root) = tree_remove(RIGHT(root), block);
+    return root;
+}
+
+/**
+ * @brief Finds the smallest block of at least the given size,
+ * the one with the lowest address among blocks of that size.
+ * 
+ * @param root root of the treap
+ * @param size size of the block needed
+ * @return sf_block* best fitting block, NULL if none is large enough
+ */
+sf_block *tree_best_fit(sf_block *root, size_t size)
+{
+    sf_block *best = NULL;
+    while (root != NULL)
+    {
+        if (get_size(root) >= size)
+        {
+            best = root;
+            root = LEFT(root);
+        }
+        else
+        {
+            root = RIGHT(root);
+        }
+    }
+    return best;
+}
@@ -1,12 +1,36 @@
+#define _GNU_SOURCE
 #include <criterion/criterion.h>
 #include <errno.h>
 #include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "debug.h"
 #include "sfmm.h"
 #include "mem.h"
 #include "heap.h"
+#include "tcache.h"
+#include "arena.h"
+#include "slab.h"
+#include "stats.h"
+#include "mapped.h"
+#include "backend.h"
+#include "quick.h"
+#include "region.h"
+#include "profile.h"
+#include <pthread.h>
+#include <sched.h>
 #define TEST_TIMEOUT 15
 
+/*
+ * Tests run against the malloc backend, which commits the whole heap up front, so that
+ * tests poking at memory past the end of the heap do not fault. Tests of the mmap
+ * backend select it again, which is allowed until the first allocation.
+ */
+__attribute__((constructor)) static void use_malloc_backend() {
+	sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_MALLOC);
+}
+
 /*
  * Assert the total number of free blocks of a specified size.
  * If size == 0, then assert the total number of all free blocks.
@@ -268,7 +292,7 @@ Test(sfmm_student_suite, get_footer_returns_valid_answer, .timeout = TEST_TIMEOU
 // }
 
 Test(sfmm_student_suite, prologue_init_correctly, .timeout = TEST_TIMEOUT) {
-	init_heap();
+	init_heap(&main_arena);
 
 	size_t *heap_start = sf_mem_start();
 	heap_start += 6;
@@ -280,7 +304,7 @@ Test(sfmm_student_suite, prologue_init_correctly, .timeout = TEST_TIMEOUT) {
 }
 
 Test(sfmm_student_suite, epilogue_init_correctly, .timeout = TEST_TIMEOUT) {
-	init_heap();
+	init_heap(&main_arena);
 	int SIZE_OF_EPILOGUE = 1;
 	size_t *heap_end = sf_mem_end();
 	heap_end--;
@@ -289,7 +313,7 @@ Test(sfmm_student_suite, epilogue_init_correctly, .timeout = TEST_TIMEOUT) {
 }
 
 // Test(sfmm_student_suite, add_block_to_freelist_to_first, .timeout = TEST_TIMEOUT) {
-// 	init_heap();
+// 	init_heap(&main_arena);
 //     int class_sizes[9] = {1,2,3,5,8,13,21,34,35};
 // 	sf_block *test_block;
 // 	size_t block_size;
@@ -306,7 +330,7 @@ Test(sfmm_student_suite, epilogue_init_correctly, .timeout = TEST_TIMEOUT) {
 // }
 
 Test(sfmm_student_suite, remove_free_block, .timeout = TEST_TIMEOUT) {
-	init_heap();
+	init_heap(&main_arena);
 	sf_block *free_block = sf_free_list_heads[8].body.links.next;
 	remove_from_freelist(free_block);
 
@@ -317,9 +341,9 @@ Test(sfmm_student_suite, remove_free_block, .timeout = TEST_TIMEOUT) {
 }
 
 Test(sfmm_student_suite, get_block_returns_correct_block, .timeout = TEST_TIMEOUT) {
-	init_heap();
+	init_heap(&main_arena);
 
-	sf_block *block = find_block(64);
+	sf_block *block = find_block(&main_arena, 64);
 	size_t expected = 8064;
 	size_t actual = get_size(block);
 
@@ -337,3 +361,940 @@ Test(sfmm_student_suite, split_places_remainder_in_freelist, .timeout = TEST_TIM
 
 	cr_assert(expected == actual, "Expected %d vs actual %d", expected, actual);
 }
+
+Test(sfmm_student_suite, tcache_reuses_freed_block, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_TCACHE, 1);
+	void *x = sf_malloc(200);
+	sf_free(x);
+	void *y = sf_malloc(200);
+
+	cr_assert(x == y, "Expected %p vs actual %p", x, y);
+	// The rest of the refill batch is cached, not on the free lists
+	assert_free_block_count(0, 0, 1);
+	assert_free_block_count(8064 - TCACHE_FILL_COUNT * 256, 8, 1);
+}
+
+Test(sfmm_student_suite, tcache_disable_flushes_blocks, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_TCACHE, 1);
+	void *x = sf_malloc(100);
+	void *y = sf_malloc(300);
+	sf_free(x);
+	sf_free(y);
+	sf_mallopt(SF_OPT_TCACHE, 0);
+
+	assert_free_block_count(0, 0, 1);
+	assert_free_block_count(8064, 8, 1);
+}
+
+Test(sfmm_student_suite, tcache_rejects_bad_size, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+	sf_mallopt(SF_OPT_TCACHE, 1);
+	char *x = sf_malloc(100);
+	// A block of size 0 has no bin of its own
+	((sf_block *)(x - 16))->header = PREV_BLOCK_ALLOCATED | THIS_BLOCK_ALLOCATED;
+	sf_free(x);
+}
+
+static void *tcache_worker(void *arg) {
+	void *ptrs[64];
+	for (int round = 0; round < 200; round++) {
+		for (int i = 0; i < 64; i++) {
+			ptrs[i] = sf_malloc(8 + (i % 8) * 64);
+			cr_assert_not_null(ptrs[i], "sf_malloc failed in thread");
+			*(long *)ptrs[i] = i;
+		}
+		for (int i = 0; i < 64; i++) {
+			cr_assert(*(long *)ptrs[i] == i, "Block was handed out twice");
+			sf_free(ptrs[i]);
+		}
+	}
+	return NULL;
+}
+
+Test(sfmm_student_suite, tcache_threads, .timeout = TEST_TIMEOUT) {
+	pthread_t threads[4];
+	sf_mallopt(SF_OPT_TCACHE, 1);
+	for (int i = 0; i < 4; i++)
+		pthread_create(&threads[i], NULL, tcache_worker, NULL);
+	for (int i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+
+	// Caches are flushed on thread exit
+	assert_free_block_count(0, 0, 1);
+}
+
+static void *arena_malloc_worker(void *arg) {
+	return sf_malloc(*(size_t *)arg);
+}
+
+Test(sfmm_student_suite, arena_free_returns_to_owner, .timeout = TEST_TIMEOUT) {
+	pthread_t thread;
+	size_t sz = 500;
+	void *x, *y;
+	sf_mallopt(SF_OPT_ARENA_MAX, 2);
+	x = sf_malloc(sz);
+	pthread_create(&thread, NULL, arena_malloc_worker, &sz);
+	pthread_join(thread, &y);
+
+	cr_assert_not_null(y, "y is NULL!");
+	cr_assert(arena_of((char *)x - 16) == &main_arena, "x is not in the main arena");
+	cr_assert(arena_of((char *)y - 16) == &sf_arenas[1], "y is not in the second arena");
+
+	sf_free(y);
+	// The main arena's free lists are untouched
+	assert_free_block_count(0, 0, 1);
+	assert_free_block_count(7552, 8, 1);
+	sf_block *bp = sf_arenas[1].free_list_heads[8].body.links.next;
+	cr_assert((bp->header & ~0x3f) == 8064, "Block was not coalesced in its own arena");
+}
+
+static void *arena_worker(void *arg) {
+	void *ptrs[32];
+	for (int round = 0; round < 100; round++) {
+		for (int i = 0; i < 32; i++) {
+			ptrs[i] = sf_malloc(100 + i * 40);
+			cr_assert_not_null(ptrs[i], "sf_malloc failed in thread");
+			memset(ptrs[i], i, 100);
+		}
+		for (int i = 0; i < 32; i += 2)
+			ptrs[i] = sf_realloc(ptrs[i], 200 + i * 80);
+		for (int i = 0; i < 32; i++) {
+			cr_assert(*(char *)ptrs[i] == i, "Block was handed out twice");
+			sf_free(ptrs[i]);
+		}
+	}
+	return NULL;
+}
+
+Test(sfmm_student_suite, arena_threads, .timeout = TEST_TIMEOUT) {
+	pthread_t threads[8];
+	sf_mallopt(SF_OPT_ARENA_MAX, 4);
+	for (int i = 0; i < 8; i++)
+		pthread_create(&threads[i], NULL, arena_worker, NULL);
+	for (int i = 0; i < 8; i++)
+		pthread_join(threads[i], NULL);
+
+	for (int i = 1; i < 4; i++)
+		cr_assert_not_null(sf_arenas[i].free_list_heads, "Arena %d was never used", i);
+}
+
+Test(sfmm_student_suite, size_class_boundaries, .timeout = TEST_TIMEOUT) {
+	size_t sizes[] = {64, 128, 192, 256, 320, 384, 512, 576, 832, 896, 1344, 1408, 2176, 2240, 100000};
+	int classes[] = {0, 1, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8};
+
+	for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		cr_assert(size_class(sizes[i]) == classes[i], "Size %ld: expected class %d vs actual %d",
+			  sizes[i], classes[i], size_class(sizes[i]));
+}
+
+Test(sfmm_student_suite, nonempty_bitmap_tracks_lists, .timeout = TEST_TIMEOUT) {
+	sf_malloc(8);
+	void *y = sf_malloc(200);
+	sf_malloc(1);
+
+	cr_assert(main_arena.nonempty[0] == (1 << 8), "Expected %#x vs actual %#lx", 1 << 8, main_arena.nonempty[0]);
+	sf_free(y);
+	cr_assert(main_arena.nonempty[0] == ((1 << 8) | (1 << 3)), "Expected %#x vs actual %#lx",
+		  (1 << 8) | (1 << 3), main_arena.nonempty[0]);
+	void *z = sf_malloc(200);
+	cr_assert(z == y, "Expected %p vs actual %p", y, z);
+	cr_assert(main_arena.nonempty[0] == (1 << 8), "Expected %#x vs actual %#lx", 1 << 8, main_arena.nonempty[0]);
+}
+
+Test(sfmm_student_suite, large_class_best_fit, .timeout = TEST_TIMEOUT) {
+	void *a = sf_malloc(3000);
+	sf_malloc(1);
+	void *b = sf_malloc(5000);
+	sf_malloc(1);
+	void *c = sf_malloc(2500);
+	sf_malloc(1);
+
+	sf_free(c);
+	sf_free(b);
+	sf_free(a);
+
+	// First fit would take a, the most recently freed block
+	void *x = sf_malloc(2400);
+	cr_assert(x == c, "Expected %p vs actual %p", c, x);
+	void *y = sf_malloc(2900);
+	cr_assert(y == a, "Expected %p vs actual %p", a, y);
+}
+
+Test(sfmm_student_suite, large_class_random_reuse, .timeout = TEST_TIMEOUT) {
+	void *ptrs[16] = {NULL};
+	size_t sizes[16];
+	srand(320);
+
+	for (int round = 0; round < 2000; round++) {
+		int i = rand() % 16;
+		if (ptrs[i] != NULL) {
+			for (size_t j = 0; j < sizes[i]; j += 512)
+				cr_assert(((char *)ptrs[i])[j] == (char)i, "Block %d was overwritten", i);
+			sf_free(ptrs[i]);
+			ptrs[i] = NULL;
+		} else {
+			sizes[i] = 2200 + rand() % 4000;
+			ptrs[i] = sf_malloc(sizes[i]);
+			cr_assert_not_null(ptrs[i], "ptrs[%d] is NULL!", i);
+			memset(ptrs[i], i, sizes[i]);
+		}
+	}
+	for (int i = 0; i < 16; i++)
+		if (ptrs[i] != NULL)
+			sf_free(ptrs[i]);
+	assert_free_block_count(0, 0, 1);
+}
+
+Test(sfmm_student_suite, slab_packs_small_objects, .timeout = TEST_TIMEOUT) {
+	char *ptrs[100];
+	sf_mallopt(SF_OPT_SLAB, 1);
+	for (int i = 0; i < 100; i++) {
+		ptrs[i] = sf_malloc(8);
+		cr_assert_not_null(ptrs[i], "ptrs[%d] is NULL!", i);
+		*ptrs[i] = i;
+	}
+	for (int i = 1; i < 100; i++) {
+		cr_assert(ptrs[i] - ptrs[i - 1] == 8, "Objects %d and %d are not packed", i - 1, i);
+		cr_assert(((uintptr_t)ptrs[i] & ~(uintptr_t)(SLAB_SIZE - 1)) == ((uintptr_t)ptrs[0] & ~(uintptr_t)(SLAB_SIZE - 1)),
+			  "Objects are in different slabs");
+	}
+	for (int i = 0; i < 100; i++)
+		cr_assert(*ptrs[i] == i, "Object %d was overwritten", i);
+}
+
+Test(sfmm_student_suite, slab_free_does_not_coalesce, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_SLAB, 1);
+	void *x = sf_malloc(16);
+	void *y = sf_malloc(16);
+	void *w = sf_malloc(200);
+	size_t free_blocks = 0;
+	for (sf_block *bp = sf_free_list_heads[8].body.links.next; bp != &sf_free_list_heads[8]; bp = bp->body.links.next)
+		free_blocks++;
+
+	sf_free(x);
+	assert_free_block_count(0, 0, free_blocks);
+	void *z = sf_malloc(10);
+	cr_assert(z == x, "Expected %p vs actual %p", x, z);
+	sf_free(y);
+	sf_free(z);
+	sf_free(w);
+}
+
+Test(sfmm_student_suite, slab_empty_slab_released, .timeout = TEST_TIMEOUT) {
+	void *ptrs[200];
+	sf_mallopt(SF_OPT_SLAB, 1);
+	for (int i = 0; i < 200; i++)
+		ptrs[i] = sf_malloc(48);
+	cr_assert(main_arena.slabs[3] != NULL && main_arena.slabs[3]->next == NULL, "Expected one partial slab");
+	for (int i = 0; i < 200; i++)
+		sf_free(ptrs[i]);
+
+	// One empty slab is kept, the others went back to the free lists
+	sf_slab *slab = main_arena.slabs[3];
+	cr_assert(slab != NULL && slab->next == NULL, "Expected one slab left");
+	cr_assert(slab->num_free == slab->num_objects, "Slab is not empty");
+	assert_free_block_count(0, 0, 2);
+}
+
+Test(sfmm_student_suite, slab_double_free, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+	sf_mallopt(SF_OPT_SLAB, 1);
+	void *x = sf_malloc(32);
+	sf_free(x);
+	sf_free(x);
+}
+
+Test(sfmm_student_suite, realloc_absorbs_free_neighbour, .timeout = TEST_TIMEOUT) {
+	void *x = sf_malloc(100);
+	void *y = sf_malloc(200);
+	/* void *z = */ sf_malloc(1);
+	sf_free(y);
+
+	void *x1 = sf_realloc(x, 250);
+	cr_assert(x1 == x, "Expected %p vs actual %p", x, x1);
+	cr_assert(sf_counters.realloc_in_place == 1, "Copy was not avoided");
+	cr_assert(sf_counters.realloc_copied == 0, "Block was copied");
+
+	sf_block *bp = (sf_block *)((char *)x1 - 16);
+	cr_assert((bp->header & ~0x3f) == 320, "Block size (%ld) not what was expected (%ld)!",
+		  bp->header & ~0x3f, 320);
+	assert_free_block_count(0, 0, 2);
+	assert_free_block_count(64, 0, 1);
+}
+
+Test(sfmm_student_suite, realloc_grows_heap_in_place, .timeout = TEST_TIMEOUT) {
+	char *x = sf_malloc(8000);
+	memset(x, 'a', 8000);
+	char *x1 = sf_realloc(x, 20000);
+
+	cr_assert(x1 == x, "Expected %p vs actual %p", x, x1);
+	cr_assert(sf_counters.realloc_in_place == 1, "Copy was not avoided");
+	cr_assert(x1[7999] == 'a', "Contents were lost");
+	cr_assert(sf_mem_start() + 3 * PAGE_SZ == sf_mem_end(), "Heap grew more than necessary");
+	assert_free_block_count(0, 0, 1);
+}
+
+Test(sfmm_student_suite, realloc_too_large_in_place, .timeout = TEST_TIMEOUT) {
+	char *x = sf_malloc(8000);
+	memset(x, 'a', 8000);
+
+	cr_assert_null(sf_realloc(x, SIZE_MAX - 100), "Block grew past the heap");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	cr_assert(x[7999] == 'a', "Contents were lost");
+	cr_assert(sf_malloc_usable_size(x) == 8056, "Block was resized to %zu", sf_malloc_usable_size(x));
+}
+
+Test(sfmm_student_suite, realloc_copy_counted, .timeout = TEST_TIMEOUT) {
+	void *x = sf_malloc(8);
+	/* void *y = */ sf_malloc(8);
+	void *x1 = sf_realloc(x, 60);
+
+	cr_assert(x1 != x, "Block could not have grown in place");
+	cr_assert(sf_counters.realloc_copied == 1, "Copy was not counted");
+	cr_assert(sf_counters.realloc_in_place == 0, "Copy was counted as avoided");
+	sf_block *bp = (sf_block *)((char *)x1 - 16);
+	cr_assert((bp->header & ~0x3f) == 128, "Block size (%ld) not what was expected (%ld)!",
+		  bp->header & ~0x3f, 128);
+}
+
+Test(sfmm_student_suite, mmap_large_request, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	sf_mallopt(SF_OPT_MMAP_THRESHOLD, 65536);
+	char *x = sf_malloc(524288);
+
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(is_mapped(x), "x is not a mapped block");
+	cr_assert(((size_t *)x)[-1] & MAPPED_BLOCK, "Mapped bit is not set!");
+	x[0] = 'a';
+	x[524287] = 'z';
+	// The heap is not touched
+	cr_assert(sf_mem_start() == sf_mem_end(), "Heap was initialized");
+
+	x = sf_realloc(x, 1048576);
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(x[0] == 'a' && x[524287] == 'z', "Contents were lost");
+	sf_free(x);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sfmm_student_suite, free_null, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+	sf_free(NULL);
+}
+
+Test(sfmm_student_suite, free_wild_pointer, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+	sf_malloc(100);
+	sf_free((void *)0x1000);
+}
+
+Test(sfmm_student_suite, realloc_null, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+	sf_realloc(NULL, 10);
+}
+
+Test(sfmm_student_suite, free_fake_mapped_header, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+	static size_t fake[1024] __attribute__((aligned(4096)));
+	sf_mallopt(SF_OPT_MMAP_THRESHOLD, 65536);
+	sf_free(sf_malloc(524288));
+
+	// Looks like a mapped block, but was never handed out
+	fake[ALIGNMENT_SIZE / sizeof(size_t) - 1] = 8192 | MAPPED_BLOCK | THIS_BLOCK_ALLOCATED;
+	sf_free(&fake[ALIGNMENT_SIZE / sizeof(size_t)]);
+}
+
+Test(sfmm_student_suite, mmap_below_threshold_uses_heap, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_MMAP_THRESHOLD, 262144);
+	// Too large for the heap, but below the threshold
+	void *x = sf_malloc(200000);
+	cr_assert_null(x, "x is not NULL!");
+	void *y = sf_malloc(1000);
+	cr_assert(!is_mapped(y), "y is a mapped block");
+	sf_free(y);
+	assert_free_block_count(0, 0, 1);
+}
+
+static int resident_pages(void *start, size_t length) {
+	unsigned char vec[64];
+	int count = 0;
+	cr_assert(length / getpagesize() <= sizeof(vec), "Range too large");
+	cr_assert(mincore(start, length, vec) == 0, "mincore failed");
+	for (size_t i = 0; i < length / getpagesize(); i++)
+		count += vec[i] & 1;
+	return count;
+}
+
+Test(sfmm_student_suite, trim_releases_free_pages, .timeout = TEST_TIMEOUT) {
+	char *x = sf_malloc(100000);
+	/* void *y = */ sf_malloc(8);
+	memset(x, 1, 100000);
+	char *pages = (char *)(((uintptr_t)x + PAGE_SZ) & ~(PAGE_SZ - 1));
+	cr_assert(resident_pages(pages, 8 * PAGE_SZ) == 8 * PAGE_SZ / getpagesize(), "Pages are not resident");
+
+	sf_free(x);
+	cr_assert(sf_trim(0) == 1, "Nothing was released");
+	cr_assert(resident_pages(pages, 8 * PAGE_SZ) == 0, "Pages are still resident");
+
+	// The released block is still usable
+	assert_free_block_count(0, 0, 2);
+	x = sf_malloc(100000);
+	cr_assert_not_null(x, "x is NULL!");
+}
+
+static void *trim_worker(void *arg) {
+	void *x = sf_malloc(200000);
+	sf_free(x);
+	return NULL;
+}
+
+Test(sfmm_student_suite, trim_shrinks_arena, .timeout = TEST_TIMEOUT) {
+	pthread_t thread;
+	sf_mallopt(SF_OPT_ARENA_MAX, 2);
+	sf_malloc(8);
+	pthread_create(&thread, NULL, trim_worker, NULL);
+	pthread_join(thread, NULL);
+
+	sf_arena *arena = &sf_arenas[1];
+	cr_assert(arena->end - arena->start > 20 * PAGE_SZ, "Arena did not grow");
+	cr_assert(sf_trim(0) == 1, "Nothing was released");
+	cr_assert(arena->end - arena->start == PAGE_SZ, "Arena is %ld bytes", arena->end - arena->start);
+	cr_assert((*(size_t *)(arena->end - 8) & 0x3) == 0x1, "Epilogue is wrong");
+	cr_assert((arena->free_list_heads[8].body.links.next->header & ~0x3f) == 8064, "Free block is wrong");
+}
+
+Test(sfmm_student_suite, trim_threshold_on_free, .timeout = TEST_TIMEOUT) {
+	pthread_t thread;
+	sf_mallopt(SF_OPT_ARENA_MAX, 2);
+	sf_mallopt(SF_OPT_TRIM_THRESHOLD, 131072);
+	sf_malloc(8);
+	pthread_create(&thread, NULL, trim_worker, NULL);
+	pthread_join(thread, NULL);
+
+	sf_arena *arena = &sf_arenas[1];
+	cr_assert(arena->end - arena->start == PAGE_SZ, "Arena is %ld bytes", arena->end - arena->start);
+}
+
+Test(sfmm_student_suite, malloc_grows_heap_once, .timeout = TEST_TIMEOUT) {
+	void *x = sf_malloc(100000);
+
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(sf_mem_start() + 13 * PAGE_SZ == sf_mem_end(), "Heap grew by the wrong amount");
+	assert_free_block_count(0, 0, 1);
+	assert_free_block_count(6336, 8, 1);
+}
+
+Test(sfmm_student_suite, heap_max_allows_larger_heap, .timeout = TEST_TIMEOUT) {
+	cr_assert(sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_MMAP) == 1, "Backend was not changed");
+	cr_assert(sf_mallopt(SF_OPT_HEAP_MAX, 64 << 20) == 1, "Heap max was not changed");
+	void *x = sf_malloc(1 << 20);
+
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(x >= sf_mem_start() && x < sf_mem_end(), "x is not in the heap");
+	cr_assert(sf_mem_end() - sf_mem_start() == 129 * PAGE_SZ, "Heap is %ld bytes", sf_mem_end() - sf_mem_start());
+	memset(x, 1, 1 << 20);
+}
+
+Test(sfmm_student_suite, heap_options_fixed_after_first_use, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	sf_malloc(8);
+
+	cr_assert(sf_mallopt(SF_OPT_HEAP_MAX, 64 << 20) == 0, "Heap max was changed");
+	cr_assert(sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_MMAP) == 0, "Backend was changed");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+	cr_assert_null(sf_malloc(524288), "Heap grew past its maximum");
+}
+
+Test(sfmm_student_suite, mmap_backend_shrinks_heap, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_MMAP);
+	void *x = sf_malloc(100000);
+	sf_free(x);
+
+	cr_assert(sf_trim(0) == 1, "Nothing was released");
+	cr_assert(sf_mem_start() + PAGE_SZ == sf_mem_end(), "Heap did not shrink");
+	assert_free_block_count(8064, 8, 1);
+
+	x = sf_malloc(100000);
+	cr_assert_not_null(x, "x is NULL!");
+	memset(x, 1, 100000);
+}
+
+Test(sfmm_student_suite, thp_backend_aligns_heap, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_THP);
+	sf_mallopt(SF_OPT_HEAP_MAX, 64 << 20);
+	char *x = sf_malloc(4 << 20);
+
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(((uintptr_t)sf_mem_start() & (HUGE_PAGE_SZ - 1)) == 0, "Heap is not huge page aligned");
+	memset(x, 1, 4 << 20);
+
+	sf_free(x);
+	cr_assert(sf_trim(0) == 1, "Nothing was released");
+	cr_assert(sf_mem_start() + PAGE_SZ == sf_mem_end(), "Heap did not shrink");
+	x = sf_malloc(4 << 20);
+	cr_assert_not_null(x, "x is NULL!");
+	memset(x, 1, 4 << 20);
+}
+
+Test(sfmm_student_suite, thp_backend_backs_arenas, .timeout = TEST_TIMEOUT) {
+	pthread_t thread;
+	size_t sz = 4 << 20;
+	char *y;
+	sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_THP);
+	sf_mallopt(SF_OPT_ARENA_MAX, 2);
+	sf_malloc(100);
+	pthread_create(&thread, NULL, arena_malloc_worker, &sz);
+	pthread_join(thread, (void **)&y);
+
+	sf_arena *arena = &sf_arenas[1];
+	cr_assert_not_null(y, "y is NULL!");
+	cr_assert(arena_of(y - 16) == arena, "y is not in the second arena");
+	cr_assert(((uintptr_t)arena->start & (HUGE_PAGE_SZ - 1)) == 0, "Arena is not huge page aligned");
+	cr_assert(((uintptr_t)arena->committed & (HUGE_PAGE_SZ - 1)) == 0, "Arena was not committed in huge pages");
+	memset(y, 1, sz);
+
+	sf_free(y);
+	cr_assert(sf_trim(0) == 1, "Nothing was released");
+	cr_assert(arena->committed == arena->start + HUGE_PAGE_SZ, "Arena kept %zu bytes", (size_t)(arena->committed - arena->start));
+}
+
+Test(sfmm_student_suite, hugetlb_backend_falls_back, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_HUGETLB);
+	sf_mallopt(SF_OPT_HEAP_MAX, 1L << 30);
+	char *x = sf_malloc(1 << 20);
+
+	// Either backend gives an aligned heap; the hugetlbfs pool is usually too small for 1 GB
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(((uintptr_t)sf_mem_start() & (HUGE_PAGE_SZ - 1)) == 0, "Heap is not huge page aligned");
+	memset(x, 1, 1 << 20);
+}
+
+Test(sfmm_student_suite, defer_coalesce_reuses_block, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_DEFER_COALESCE, 1);
+	void *x = sf_malloc(200);
+	/* void *y = */ sf_malloc(200);
+
+	sf_free(x);
+	assert_free_block_count(0, 0, 1);
+	cr_assert(sf_malloc(200) == x, "Listed block was not reused");
+}
+
+Test(sfmm_student_suite, defer_coalesce_consolidates_on_miss, .timeout = TEST_TIMEOUT) {
+	void *blocks[7];
+	sf_mallopt(SF_OPT_DEFER_COALESCE, 1);
+	for (int i = 0; i < 7; i++)
+		blocks[i] = sf_malloc(1000);
+	for (int i = 0; i < 7; i++)
+		sf_free(blocks[i]);
+	assert_free_block_count(896, 6, 1);
+
+	void *x = sf_malloc(2000);
+	cr_assert(x == blocks[0], "Blocks were not consolidated");
+	cr_assert(sf_mem_start() + PAGE_SZ == sf_mem_end(), "Heap grew instead");
+	assert_free_block_count(0, 0, 1);
+	assert_free_block_count(6016, 8, 1);
+}
+
+Test(sfmm_student_suite, defer_coalesce_consolidates_long_list, .timeout = TEST_TIMEOUT) {
+	void *blocks[QUICK_LIST_MAX + 1];
+	sf_mallopt(SF_OPT_DEFER_COALESCE, 1);
+	for (int i = 0; i <= QUICK_LIST_MAX; i++)
+		blocks[i] = sf_malloc(8);
+	for (int i = 0; i < QUICK_LIST_MAX; i++)
+		sf_free(blocks[i]);
+	assert_free_block_count(0, 0, 1);
+
+	sf_free(blocks[QUICK_LIST_MAX]);
+	assert_free_block_count(0, 0, 1);
+	assert_free_block_count(8064, 8, 1);
+}
+
+Test(sfmm_student_suite, memalign_page, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	char *x = sf_memalign(4096, 1000);
+
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert(((uintptr_t)x & 4095) == 0, "x is not page aligned");
+	memset(x, 1, 1000);
+	// Leading and trailing fragments are free
+	assert_free_block_count(0, 0, 2);
+
+	sf_free(x);
+	assert_free_block_count(0, 0, 1);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sfmm_student_suite, memalign_huge_page, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_MMAP);
+	sf_mallopt(SF_OPT_HEAP_MAX, 64 << 20);
+	char *x = sf_memalign(HUGE_PAGE_SZ, 100000);
+	char *y = sf_memalign(HUGE_PAGE_SZ, 100000);
+
+	cr_assert_not_null(x, "x is NULL!");
+	cr_assert_not_null(y, "y is NULL!");
+	cr_assert(((uintptr_t)x & (HUGE_PAGE_SZ - 1)) == 0, "x is not huge page aligned");
+	cr_assert(((uintptr_t)y & (HUGE_PAGE_SZ - 1)) == 0, "y is not huge page aligned");
+	memset(x, 1, 100000);
+	memset(y, 1, 100000);
+	// The heap only grew by what the second block needed beyond the fragment left by the first
+	cr_assert(sf_mem_end() - sf_mem_start() < 3 * HUGE_PAGE_SZ, "Heap is %ld bytes", sf_mem_end() - sf_mem_start());
+}
+
+Test(sfmm_student_suite, memalign_invalid_alignment, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *x = sf_memalign(96, 8);
+
+	cr_assert_null(x, "x is not NULL!");
+	cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL!");
+}
+
+Test(sfmm_student_suite, calloc_zeroes_reused_block, .timeout = TEST_TIMEOUT) {
+	char *x = sf_malloc(20000);
+	memset(x, 0xff, 20000);
+	sf_free(x);
+
+	char *y = sf_calloc(5, 4000);
+	cr_assert_not_null(y, "y is NULL!");
+	for (int i = 0; i < 20000; i++)
+		cr_assert(y[i] == 0, "Byte %d is not zero", i);
+	// The malloc backend gives no fresh memory
+	cr_assert(sf_counters.calloc_fresh_bytes == 0, "%zu bytes were not cleared", sf_counters.calloc_fresh_bytes);
+}
+
+Test(sfmm_student_suite, calloc_skips_fresh_memory, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_BACKEND, SF_BACKEND_MMAP);
+	sf_mallopt(SF_OPT_HEAP_MAX, 64 << 20);
+	size_t size = 4 << 20;
+	char *x = sf_calloc(1, size);
+
+	cr_assert_not_null(x, "x is NULL!");
+	for (size_t i = 0; i < size; i++)
+		cr_assert(x[i] == 0, "Byte %zu is not zero", i);
+	cr_assert(sf_counters.calloc_fresh_bytes > size - PAGE_SZ, "Only %zu bytes were fresh", sf_counters.calloc_fresh_bytes);
+
+	memset(x, 0xff, size);
+	sf_free(x);
+	char *y = sf_calloc(size, 1);
+	for (size_t i = 0; i < size; i++)
+		cr_assert(y[i] == 0, "Byte %zu is not zero", i);
+}
+
+Test(sfmm_student_suite, calloc_skips_released_pages, .timeout = TEST_TIMEOUT) {
+	size_t size = 5 * PAGE_SZ;
+	char *x = sf_malloc(size);
+	memset(x, 0xff, size);
+	// Keeps the heap from shrinking over x
+	sf_malloc(100);
+	sf_free(x);
+	cr_assert(sf_trim(0) == 1, "Nothing was released");
+
+	char *y = sf_calloc(size, 1);
+	cr_assert(y == x, "Expected %p vs actual %p", x, y);
+	for (size_t i = 0; i < size; i++)
+		cr_assert(y[i] == 0, "Byte %zu is not zero", i);
+	cr_assert(sf_counters.calloc_fresh_bytes >= 3 * PAGE_SZ, "Only %zu bytes were released", sf_counters.calloc_fresh_bytes);
+
+	// Once the block is written and freed again its pages are cleared
+	memset(y, 0xff, size);
+	sf_free(y);
+	y = sf_calloc(size, 1);
+	for (size_t i = 0; i < size; i++)
+		cr_assert(y[i] == 0, "Byte %zu is not zero", i);
+}
+
+Test(sfmm_student_suite, calloc_overflow, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *x = sf_calloc(SIZE_MAX / 2, 4);
+
+	cr_assert_null(x, "x is not NULL!");
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+}
+
+Test(sfmm_student_suite, malloc_batch_carves_one_block, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *blocks[10];
+	size_t count = sf_malloc_batch(100, 10, blocks);
+
+	cr_assert(count == 10, "Allocated %zu blocks", count);
+	for (int i = 0; i < 10; i++) {
+		cr_assert((char *)blocks[i] == (char *)blocks[0] + i * 128, "Block %d is not next to the previous one", i);
+		memset(blocks[i], i, 100);
+	}
+	assert_free_block_count(0, 0, 1);
+	assert_free_block_count(8064 - 10 * 128, 8, 1);
+	cr_assert(sf_errno == 0, "sf_errno is not zero!");
+}
+
+Test(sfmm_student_suite, malloc_batch_partial, .timeout = TEST_TIMEOUT) {
+	sf_errno = 0;
+	void *blocks[100];
+	size_t count = sf_malloc_batch(8000, 100, blocks);
+
+	// 16 pages hold 16 blocks of 8064 bytes besides the prologue and epilogue
+	cr_assert(count == 16, "Allocated %zu blocks", count);
+	cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM!");
+	sf_free_batch(blocks, count);
+	assert_free_block_count(0, 0, 1);
+}
+
+Test(sfmm_student_suite, free_batch_coalesces, .timeout = TEST_TIMEOUT) {
+	void *blocks[8];
+	for (int i = 0; i < 8; i++)
+		blocks[i] = sf_malloc(200);
+	void *kept = sf_malloc(200);
+	void *shuffled[] = { blocks[5], blocks[1], NULL, blocks[7], blocks[0], blocks[3], blocks[6], blocks[2], blocks[4] };
+
+	sf_free_batch(shuffled, 9);
+	assert_free_block_count(0, 0, 2);
+	assert_free_block_count(8 * 256, 7, 1);
+	sf_free(kept);
+	assert_free_block_count(0, 0, 1);
+}
+
+Test(sfmm_student_suite, free_sized, .timeout = TEST_TIMEOUT) {
+	void *x = sf_malloc(100);
+	void *y = sf_malloc(150);
+
+	sf_free_sized(x, 100);
+	sf_free_sized(y, 150);
+	assert_free_block_count(0, 0, 1);
+	assert_free_block_count(8064, 8, 1);
+}
+
+Test(sfmm_student_suite, free_sized_wrong_size, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+	void *x = sf_malloc(100);
+	sf_free_sized(x, 1000);
+}
+
+Test(sfmm_student_suite, usable_size_fills_block, .timeout = TEST_TIMEOUT) {
+	char *x = sf_malloc(100);
+	size_t usable = sf_malloc_usable_size(x);
+
+	cr_assert(usable == 120, "Usable size is %zu", usable);
+	memset(x, 1, usable);
+	cr_assert(sf_realloc(x, usable) == x, "Block moved");
+	cr_assert(sf_malloc_usable_size(NULL) == 0, "Usable size of NULL");
+
+	sf_free_sized(x, usable);
+	assert_free_block_count(0, 0, 1);
+}
+
+Test(sfmm_student_suite, stats_count_blocks, .timeout = TEST_TIMEOUT) {
+	void *x = sf_malloc(100);
+	void *y = sf_malloc(1000);
+	sf_malloc(100);
+	sf_free(y);
+	sf_free(x);
+
+	struct sf_stats stats;
+	sf_get_stats(&stats);
+	cr_assert(stats.mallocs == 3, "%zu mallocs", stats.mallocs);
+	cr_assert(stats.frees == 2, "%zu frees", stats.frees);
+	cr_assert(stats.heap_bytes == PAGE_SZ, "Heap is %zu bytes", stats.heap_bytes);
+	cr_assert(stats.in_use_bytes == 128, "%zu bytes in use", stats.in_use_bytes);
+	cr_assert(stats.free_bytes == 8064 - 128, "%zu bytes free", stats.free_bytes);
+	cr_assert(stats.free_bytes_per_class[6] == 1152, "%zu bytes free in class 6", stats.free_bytes_per_class[6]);
+	cr_assert(stats.largest_free_block == 8064 - 128 - 1152, "Largest free block is %zu", stats.largest_free_block);
+	cr_assert(stats.fragmentation > 0.14 && stats.fragmentation < 0.15, "Fragmentation is %f", stats.fragmentation);
+}
+
+static void *stats_worker(void *arg) {
+	for (int i = 0; i < 10; i++)
+		sf_free(sf_malloc(100));
+	return NULL;
+}
+
+Test(sfmm_student_suite, stats_count_exited_thread, .timeout = TEST_TIMEOUT) {
+	pthread_t thread;
+	pthread_create(&thread, NULL, stats_worker, NULL);
+	pthread_join(thread, NULL);
+	sf_free(sf_malloc(100));
+
+	struct sf_stats stats;
+	sf_get_stats(&stats);
+	cr_assert(stats.mallocs == 11, "%zu mallocs", stats.mallocs);
+	cr_assert(stats.frees == 11, "%zu frees", stats.frees);
+}
+
+Test(sfmm_student_suite, stats_skip_failed_grow, .timeout = TEST_TIMEOUT) {
+	sf_mallopt(SF_OPT_HEAP_MAX, PAGE_SZ);
+	sf_malloc(100);
+	cr_assert_null(sf_malloc(20000), "Heap grew past its maximum");
+
+	struct sf_stats stats;
+	sf_get_stats(&stats);
+	cr_assert(stats.heap_grows == 0, "%zu grows", stats.heap_grows);
+}
+
+Test(sfmm_student_suite, stats_json, .timeout = TEST_TIMEOUT) {
+	sf_malloc(100);
+
+	struct sf_stats stats;
+	char json[1024];
+	sf_get_stats(&stats);
+	int length = sf_stats_json(&stats, json, sizeof(json));
+
+	cr_assert(length > 0 && length < (int)sizeof(json), "JSON is %d bytes", length);
+	cr_assert(strstr(json, "\"mallocs\": 1,") != NULL, "%s", json);
+	cr_assert(strstr(json, "\"free_bytes_per_class\": [0, 0, 0, 0, 0, 0, 0, 0, 7936]") != NULL, "%s", json);
+	cr_assert(sf_stats_json(&stats, json, 10) == length, "Truncated length differs");
+	cr_assert(strlen(json) == 9, "Not truncated");
+}
+
+static void *remote_free_worker(void *arg) {
+	// Gets the thread its own arena before freeing a block of the main one
+	sf_free(sf_malloc(100));
+	sf_free(arg);
+	return NULL;
+}
+
+Test(sfmm_student_suite, remote_free_drained_by_owner, .timeout = TEST_TIMEOUT) {
+	pthread_t thread;
+	sf_mallopt(SF_OPT_ARENA_MAX, 2);
+	sf_mallopt(SF_OPT_REMOTE_FREE, 1);
+	void *x = sf_malloc(500);
+	sf_malloc(500);
+	pthread_create(&thread, NULL, remote_free_worker, x);
+	pthread_join(thread, NULL);
+
+	// The block waits on the main arena's queue, still allocated
+	cr_assert(main_arena.remote_frees == (sf_block *)((char *)x - 16), "Block was not queued");
+	assert_free_block_count(0, 0, 1);
+
+	cr_assert(sf_malloc(500) == x, "Queued block was not reused");
+	cr_assert(main_arena.remote_frees == NULL, "Queue was not drained");
+}
+
+Test(sfmm_student_suite, percpu_arena_follows_cpu, .timeout = TEST_TIMEOUT) {
+	// Stay on one CPU so that it cannot change under the allocation
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(sched_getcpu(), &cpus);
+	cr_assert(sched_setaffinity(0, sizeof(cpus), &cpus) == 0, "Cannot pin the thread");
+
+	sf_mallopt(SF_OPT_PERCPU_ARENAS, 1);
+	void *x = sf_malloc(100);
+	cr_assert(arena_of((char *)x - 16) == &sf_arenas[sched_getcpu() % NUM_ARENAS_MAX], "x is not in the CPU's arena");
+
+	sf_mallopt(SF_OPT_ARENA_MAX, 1);
+	void *y = sf_malloc(100);
+	cr_assert(arena_of((char *)y - 16) == &main_arena, "y is not in the main arena");
+}
+
+static void *percpu_worker(void *arg) {
+	void *x = sf_malloc(200);
+	sf_free(sf_malloc(100));
+	return x;
+}
+
+Test(sfmm_student_suite, percpu_arenas_bounded_by_cpus, .timeout = TEST_TIMEOUT) {
+	pthread_t thread;
+	void *blocks[64];
+	sf_mallopt(SF_OPT_PERCPU_ARENAS, 1);
+	for (int i = 0; i < 64; i++) {
+		pthread_create(&thread, NULL, percpu_worker, NULL);
+		pthread_join(thread, &blocks[i]);
+	}
+	for (int i = 0; i < 64; i++)
+		sf_free(blocks[i]);
+
+	int arenas = 0;
+	for (int i = 0; i < NUM_ARENAS_MAX; i++)
+		if (sf_arenas[i].free_list_heads != NULL)
+			arenas++;
+	cr_assert(arenas <= sysconf(_SC_NPROCESSORS_CONF), "%d arenas for %ld CPUs", arenas, sysconf(_SC_NPROCESSORS_CONF));
+}
+
+Test(sfmm_student_suite, region_bumps_and_resets, .timeout = TEST_TIMEOUT) {
+	sf_region *region = sf_region_create(1024);
+	cr_assert_not_null(region, "region is NULL!");
+	char *x = sf_region_alloc(region, 10);
+	char *y = sf_region_alloc(region, 20);
+	cr_assert(((uintptr_t)x & (REGION_ALIGN - 1)) == 0, "x is not aligned");
+	cr_assert(y == x + 16, "y was not bumped from x");
+
+	// Fill the first chunk so that the region takes a second one
+	for (int i = 0; i < 100; i++)
+		cr_assert_not_null(sf_region_alloc(region, 100), "Region could not grow");
+	cr_assert_not_null(region->chunks, "No chunk was added");
+
+	sf_region_reset(region);
+	cr_assert_null(region->chunks, "Chunks were not freed");
+	cr_assert(sf_region_alloc(region, 10) == x, "First chunk was not reused");
+
+	sf_region_destroy(region);
+	assert_free_block_count(0, 0, 1);
+}
+
+Test(sfmm_student_suite, region_large_object, .timeout = TEST_TIMEOUT) {
+	sf_region *region = sf_region_create(1024);
+	char *x = sf_region_alloc(region, 16);
+	char *big = sf_region_alloc(region, 2000);
+	cr_assert_not_null(big, "big is NULL!");
+	memset(big, 1, 2000);
+	cr_assert(sf_region_alloc(region, 16) == x + 16, "Large object took over the current chunk");
+
+	sf_region_destroy(region);
+	assert_free_block_count(0, 0, 1);
+}
+
+static size_t read_profile(char *buf, size_t size) {
+	FILE *file = tmpfile();
+	cr_assert(sf_heap_profile_dump(fileno(file)) == 0, "Dump failed");
+	rewind(file);
+	size_t length = fread(buf, 1, size - 1, file);
+	buf[length] = '\0';
+	fclose(file);
+	return length;
+}
+
+Test(sfmm_student_suite, profile_tracks_live_samples, .timeout = TEST_TIMEOUT) {
+	static char profile[1 << 16];
+	// Sample every allocation
+	sf_mallopt(SF_OPT_PROFILE_RATE, 1);
+	void *x = sf_malloc(100);
+	void *y = sf_malloc(200);
+	cr_assert(profile_live == 2, "%zu samples", profile_live);
+
+	read_profile(profile, sizeof(profile));
+	cr_assert(strncmp(profile, "heap profile: 2: 300 [0: 0] @ heap_v2/1\n", 40) == 0, "%s", profile);
+	cr_assert(strstr(profile, "\n1: 200 [0: 0] @ 0x") != NULL, "%s", profile);
+	cr_assert(strstr(profile, "\nMAPPED_LIBRARIES:\n") != NULL, "No mappings");
+
+	sf_free(y);
+	y = sf_realloc(x, 500);
+	read_profile(profile, sizeof(profile));
+	cr_assert(strncmp(profile, "heap profile: 1: 500 ", 21) == 0, "%s", profile);
+
+	sf_mallopt(SF_OPT_PROFILE_RATE, 0);
+	sf_malloc(100);
+	sf_free(y);
+	cr_assert(profile_live == 0, "%zu samples", profile_live);
+}
+
+Test(sfmm_student_suite, profile_moves_sample_with_block, .timeout = TEST_TIMEOUT) {
+	static char profile[1 << 16];
+	sf_mallopt(SF_OPT_PROFILE_RATE, 1);
+	void *x = sf_malloc(100);
+	// Keeps x from growing in place, without a sample of its own
+	sf_mallopt(SF_OPT_PROFILE_RATE, 0);
+	sf_malloc(100);
+	sf_mallopt(SF_OPT_PROFILE_RATE, 1);
+
+	void *y = sf_realloc(x, 5000);
+	cr_assert(y != x, "x did not move");
+	cr_assert(profile_live == 1, "%zu samples", profile_live);
+	read_profile(profile, sizeof(profile));
+	cr_assert(strncmp(profile, "heap profile: 1: 5000 ", 22) == 0, "%s", profile);
+	cr_assert_null(profile_detach(x), "x kept its sample");
+	cr_assert_not_null(profile_detach(y), "y has no sample");
+}
+
+Test(sfmm_student_suite, profile_keeps_sample_of_unmoved_block, .timeout = TEST_TIMEOUT) {
+	static char profile[1 << 16];
+	sf_mallopt(SF_OPT_PROFILE_RATE, 1);
+	void *x = sf_malloc(100);
+
+	cr_assert_null(sf_realloc(x, SIZE_MAX - 100), "Realloc did not fail");
+	cr_assert(sf_realloc(x, 110) == x, "x moved");
+	read_profile(profile, sizeof(profile));
+	cr_assert(strncmp(profile, "heap profile: 1: 100 ", 21) == 0, "%s", profile);
+
+	void *ptrs[] = { x, sf_malloc(1 << 20) };
+	sf_free_batch(ptrs, 2);
+	cr_assert(profile_live == 0, "%zu samples", profile_live);
+}
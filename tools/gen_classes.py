@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Generates include/classes.h, the size-class schedules the allocator can be built with.
+
+A schedule is the list of upper bounds, in units of ALIGNMENT_SIZE bytes, of every free
+list but the last one, which holds all larger blocks. For each schedule, classes.h gets
+NUM_FREE_LISTS, the bounds and a table giving the class of every size up to
+LOOKUP_UNITS units, so that size_class() only searches the bounds for larger blocks.
+
+Running this script again, or make classes, rewrites classes.h.
+"""
+import os
+
+LOOKUP_UNITS = 64
+
+
+def fibonacci():
+    bounds = [1, 2]
+    while bounds[-1] < 34:
+        bounds.append(bounds[-1] + bounds[-2])
+    return bounds
+
+
+def pow2():
+    return [1 << i for i in range(18)]
+
+
+def geometric(steps=4, lists=64):
+    """Exact classes up to steps units, then steps classes per doubling."""
+    bounds = list(range(1, steps + 1))
+    base = steps
+    while len(bounds) < lists - 1:
+        for k in range(1, steps + 1):
+            bounds.append(base + base * k // steps)
+        base *= 2
+    return bounds[:lists - 1]
+
+
+SCHEDULES = [
+    ("FIBONACCI", fibonacci(),
+     "Fibonacci bounds (1, 2, 3, 5, 8, 13, 21, 34), the default."),
+    ("POW2", pow2(),
+     "Powers of two up to 2^17 units."),
+    ("GEOMETRIC", geometric(),
+     "Exact up to 4 units, then 4 classes per doubling."),
+]
+
+
+def lookup(bounds):
+    table = []
+    for units in range(LOOKUP_UNITS + 1):
+        cls = 0
+        while cls < len(bounds) and bounds[cls] < units:
+            cls += 1
+        table.append(cls)
+    return table
+
+
+def initializer(values, indent="    "):
+    lines, line = [], indent
+    for v in values:
+        item = "%d, " % v
+        if len(line) + len(item) > 90:
+            lines.append(line.rstrip())
+            line = indent
+        line += item
+    lines.append(line.rstrip())
+    return "{ \\\n" + " \\\n".join(lines) + " \\\n}"
+
+
+def main():
+    out = []
+    out.append("/* Generated by tools/gen_classes.py, do not edit. */\n")
+    out.append("#ifndef CLASSES_H\n#define CLASSES_H\n\n")
+    out.append("/*\n")
+    out.append(" * Size-class schedules, chosen at build time with -DSF_CLASSES=SF_CLASSES_<name>\n")
+    out.append(" * (make CLASSES=<name>). Each free list but the last holds the blocks of at most\n")
+    out.append(" * CLASS_BOUNDS[i] * ALIGNMENT_SIZE bytes that are too large for the previous list;\n")
+    out.append(" * the last one holds all larger blocks. CLASS_LOOKUP gives the class of a block of\n")
+    out.append(" * n * ALIGNMENT_SIZE bytes for n up to CLASS_LOOKUP_UNITS.\n")
+    out.append(" */\n")
+    for i, (name, _, doc) in enumerate(SCHEDULES):
+        out.append("#define SF_CLASSES_%s %d\n" % (name, i))
+    out.append("\n#ifndef SF_CLASSES\n#define SF_CLASSES SF_CLASSES_FIBONACCI\n#endif\n\n")
+    out.append("#define CLASS_LOOKUP_UNITS %d\n\n" % LOOKUP_UNITS)
+    for i, (name, bounds, doc) in enumerate(SCHEDULES):
+        out.append("%s SF_CLASSES == SF_CLASSES_%s\n" % ("#if" if i == 0 else "#elif", name))
+        out.append("/* %s */\n" % doc)
+        out.append("#define NUM_FREE_LISTS %d\n" % (len(bounds) + 1))
+        out.append("#define CLASS_BOUNDS %s\n" % initializer(bounds))
+        out.append("#define CLASS_LOOKUP %s\n" % initializer(lookup(bounds)))
+    out.append("#else\n#error \"Unknown SF_CLASSES schedule\"\n#endif\n\n")
+    out.append("#endif /* CLASSES_H */\n")
+
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    path = os.path.join(root, "include", "classes.h")
+    with open(path, "w") as f:
+        f.write("".join(out))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Generates the standard traces replayed by bin/mdriver.
+
+Traces use the malloclab format: a header of four lines (suggested heap size, number of
+ids, number of operations, weight) followed by one operation per line:
+
+    a <id> <size>   allocate size bytes and call the block id
+    r <id> <size>   reallocate block id to size bytes
+    f <id>          free block id
+
+Every block is freed by the end of a trace. The traces are generated from fixed seeds,
+so running this script again reproduces them exactly.
+"""
+import os
+import random
+
+
+def write(name, ops):
+    ids = 1 + max(op[1] for op in ops)
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), name + ".rep")
+    with open(path, "w") as out:
+        out.write("%d\n%d\n%d\n1\n" % (0, ids, len(ops)))
+        for op in ops:
+            out.write(" ".join(str(x) for x in op) + "\n")
+
+
+def free_all(ops, live):
+    for i in sorted(live):
+        ops.append(("f", i))
+
+
+def short1():
+    # Tiny hand-checkable trace
+    return [("a", 0, 2040), ("a", 1, 2040), ("f", 1), ("a", 2, 48), ("a", 3, 4072),
+            ("f", 3), ("a", 4, 4072), ("f", 0), ("f", 2), ("a", 5, 4072), ("f", 4), ("f", 5)]
+
+
+def coalescing():
+    # Pairs of neighbours freed together, then a request only their union can satisfy
+    ops, next_id = [], 0
+    for _ in range(1000):
+        a, b = next_id, next_id + 1
+        ops += [("a", a, 4095), ("a", b, 4095), ("f", a), ("f", b)]
+        c = next_id + 2
+        ops += [("a", c, 8190), ("f", c)]
+        next_id += 3
+    return ops
+
+
+def random_trace(rng, count, max_size):
+    # Random sizes, freed in random order while others are still live
+    ops, live, next_id = [], set(), 0
+    while next_id < count or live:
+        if next_id < count and (not live or rng.random() < 0.55):
+            ops.append(("a", next_id, rng.randint(1, max_size)))
+            live.add(next_id)
+            next_id += 1
+        else:
+            victim = rng.choice(sorted(live))
+            ops.append(("f", victim))
+            live.remove(victim)
+    return ops
+
+
+def binary(small, large):
+    # Alternating small and large blocks; freeing the large ones leaves holes that are
+    # too small for the next, slightly larger wave
+    ops, count = [], 2000
+    for i in range(count):
+        ops.append(("a", 2 * i, small))
+        ops.append(("a", 2 * i + 1, large))
+    for i in range(count):
+        ops.append(("f", 2 * i + 1))
+    for i in range(count):
+        ops.append(("a", 2 * count + i, large + 16))
+    free_all(ops, set(range(0, 2 * count, 2)) | set(range(2 * count, 3 * count)))
+    return ops
+
+
+def realloc_trace(step, blockers):
+    # A buffer grown in steps, optionally with a small block allocated right behind it
+    # each time so that it cannot always grow in place
+    ops, size = [("a", 0, 512)], 512
+    for i in range(1, 1201):
+        size += step
+        ops.append(("r", 0, size))
+        if blockers:
+            ops.append(("a", i, 128))
+            if i > 1:
+                ops.append(("f", i - 1))
+    if blockers:
+        ops.append(("f", 1200))
+    ops.append(("f", 0))
+    return ops
+
+
+def mixed(rng):
+    # Many short-lived small objects with a few long-lived large ones
+    ops, live, next_id = [], {}, 0
+    for step in range(20000):
+        if rng.random() < 0.02:
+            size = rng.randint(4096, 65536)
+        else:
+            size = rng.choice([8, 16, 24, 32, 48, 64, 96, 128, 200, 256])
+        ops.append(("a", next_id, size))
+        live[next_id] = step + (rng.randint(1000, 20000) if size > 4096 else rng.randint(1, 200))
+        next_id += 1
+        for i in [i for i, end in live.items() if end <= step]:
+            ops.append(("f", i))
+            del live[i]
+    free_all(ops, live)
+    return ops
+
+
+if __name__ == "__main__":
+    write("short1-bal", short1())
+    write("coalescing-bal", coalescing())
+    write("random-bal", random_trace(random.Random(2), 4800, 32768))
+    write("random2-bal", random_trace(random.Random(3), 4800, 4096))
+    write("binary-bal", binary(64, 448))
+    write("binary2-bal", binary(16, 112))
+    write("realloc-bal", realloc_trace(128, True))
+    write("realloc2-bal", realloc_trace(4096, False))
+    write("mixed-bal", mixed(random.Random(8)))